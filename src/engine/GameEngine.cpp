@@ -9,111 +9,282 @@
 #include "GameEngine.h"
 
 namespace engine {
+    static const size_t OBJECT_CHUNKS_PER_AXIS = 4;
+
+    static const size_t OCCLUDER_COUNT = 4;
+
+    static const unsigned int DEPTH_PYRAMID_TEXEL_SIZE = 8;
+
+    static const float Z_NEAR = 0.1f;
+
+    static const size_t STEADY_STATE_WARMUP_FRAMES = 3;
+
+    static const float CAMERA_RADIUS = 0.5f;
+
+    static const float MILLISECONDS_PER_TIME_UNIT = 100.f;
+
+    OcclusionStatistics &OcclusionStatistics::operator+=(const OcclusionStatistics &other) {
+        objectsTested += other.objectsTested;
+        objectsRejected += other.objectsRejected;
+        trianglesRejected += other.trianglesRejected;
+        return *this;
+    }
+
+    MeshletStatistics &MeshletStatistics::operator+=(const MeshletStatistics &other) {
+        meshletsTested += other.meshletsTested;
+        meshletsRejected += other.meshletsRejected;
+        trianglesRejected += other.trianglesRejected;
+        return *this;
+    }
+
     GameEngine::GameEngine(
             uint8_t fps,
             unsigned int screenWidth,
             unsigned int screenHeight) :
-            _cube(Mesh::loadFromObjectFile("objects/space-ship.obj")),
+            _objects(Mesh::loadFromObjectFile("objects/space-ship.obj").splitIntoChunks(OBJECT_CHUNKS_PER_AXIS)),
             _screenWidth(screenWidth),
+            _screenHeight(screenHeight),
             _projectionMatrix(_computeProjectionMatrix(screenWidth, screenHeight)),
             _sleepTime(static_cast<long long>(1000. / fps)),
+            _depthPyramid(screenWidth, screenHeight, DEPTH_PYRAMID_TEXEL_SIZE),
             _vCamera(Vec3DGraphic(0, 0, 0)),
             _window(sf::RenderWindow (sf::VideoMode(screenWidth, screenHeight), "3D Game Engine")),
             _lookDirection(Vec3DGraphic(0, 0, 1))
     {
         std::vector<Triangle3D> triangles = std::vector<Triangle3D>();
+
+        _modelNode = _sceneGraph.createNode();
+        _sceneGraph.setTranslation(_modelNode, 0.f, 0.f, 16.f);
+        for(size_t i = 0; i < _objects.size(); ++i) {
+            _objectNodes.push_back(_sceneGraph.createNode(_modelNode));
+        }
     }
 
-    void GameEngine::startLoop()
+    bool GameEngine::startLoop()
     {
         // _window.setMouseCursorVisible(false);
+        bool succeeded = true;
+        double totalFrameMilliseconds = 0.;
+        double slowestFrameMilliseconds = 0.;
+        if(_recorder) {
+            _recorder->start(_getCameraState());
+        }
         while (_window.isOpen())
         {
             try
             {
-                auto startedAt = std::chrono::steady_clock::now();
-                std::this_thread::sleep_for(std::chrono::milliseconds(_sleepTime));
-                auto currentTime = std::chrono::steady_clock::now();
-                auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime- startedAt).count();
-                _update(static_cast<float>(elapsedTime) / 100.f);
+                long long elapsedTime;
+                if(_replay) {
+                    // Replays run unlocked: the step comes from the log, not from the clock.
+                    if(_frameCount >= _replay->getFrameCount()) {
+                        break;
+                    }
+                    elapsedTime = _replay->getFrame(_frameCount).stepMilliseconds;
+                }
+                else {
+                    auto startedAt = std::chrono::steady_clock::now();
+                    std::this_thread::sleep_for(std::chrono::milliseconds(_sleepTime));
+                    auto currentTime = std::chrono::steady_clock::now();
+                    elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime- startedAt).count();
+                }
+                if(_recorder) {
+                    _recorder->beginFrame(static_cast<uint16_t>(std::min<long long>(elapsedTime, UINT16_MAX)));
+                }
+
+                auto frameStartedAt = std::chrono::steady_clock::now();
+                MemoryTracker::beginFrame();
+                _update(static_cast<float>(elapsedTime) / MILLISECONDS_PER_TIME_UNIT);
+                _frameMemory = MemoryTracker::endFrame();
+                double frameMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStartedAt).count();
+
+                if(_recorder) {
+                    _recorder->endFrame(_getCameraState());
+                }
+                if(_replay) {
+                    const CameraState &recorded = _replay->getFrame(_frameCount).camera;
+                    if(_getCameraState() != recorded) {
+                        ++_replayDivergedFrames;
+                        _setCameraState(recorded);
+                    }
+                    totalFrameMilliseconds += frameMilliseconds;
+                    slowestFrameMilliseconds = std::max(slowestFrameMilliseconds, frameMilliseconds);
+                    std::cout << "Frame " << _frameCount << ": " << frameMilliseconds << " ms" << std::endl;
+                }
+                ++_frameCount;
             }
             catch (GameEngineException &e)
             {
                 break;
             }
+
+            if(_strictMemory && _frameCount > STEADY_STATE_WARMUP_FRAMES && _frameMemory.allocations > 0)
+            {
+                std::cerr << "Steady-state frame " << _frameCount << " allocated " << _frameMemory.bytesAllocated
+                          << " bytes in " << _frameMemory.allocations << " allocations" << std::endl;
+                succeeded = false;
+                break;
+            }
+        }
+        std::cout << "Occlusion culling rejected " << _totalOcclusion.objectsRejected << "/" << _totalOcclusion.objectsTested
+                  << " objects and " << _totalOcclusion.trianglesRejected << " triangles" << std::endl;
+        std::cout << "Meshlet culling rejected " << _totalMeshlets.meshletsRejected << "/" << _totalMeshlets.meshletsTested
+                  << " meshlets and " << _totalMeshlets.trianglesRejected << " triangles" << std::endl;
+        if(_replay) {
+            std::cout << "Replayed " << _frameCount << " frames in " << totalFrameMilliseconds << " ms, average "
+                      << totalFrameMilliseconds / static_cast<double>(std::max<size_t>(_frameCount, 1)) << " ms, slowest "
+                      << slowestFrameMilliseconds << " ms, " << _replayDivergedFrames << " frames diverged from the recording" << std::endl;
         }
+        dumpMemory(std::cout);
+        return succeeded;
     }
 
-    void GameEngine::_update(float elapsedTime)
-    {
+    const OcclusionStatistics &GameEngine::getFrameOcclusionStatistics() const {
+        return _frameOcclusion;
+    }
 
-        _manageEvents(elapsedTime);
-         _fTheta += 0.1F * elapsedTime;
+    const OcclusionStatistics &GameEngine::getTotalOcclusionStatistics() const {
+        return _totalOcclusion;
+    }
 
-        Matrix matRotZ(4, std::vector<float>({
-            cosf(_fTheta), sinf(_fTheta), 0, 0,
-            -sinf(_fTheta), cosf(_fTheta), 0, 0,
-            0, 0, 1, 0,
-            0, 0, 0, 1
-        }));
+    const MeshletStatistics &GameEngine::getFrameMeshletStatistics() const {
+        return _frameMeshlets;
+    }
 
-        Matrix matRotX(4, std::vector<float>({
-             1, 0, 0, 0,
-             0, cosf(_fTheta * 0.5f), sinf(_fTheta * 0.5f), 0,
-             0, -sinf(_fTheta * 0.5f), cosf(_fTheta * 0.5f), 0,
-             0, 0, 0, 1
-        }));
+    const MeshletStatistics &GameEngine::getTotalMeshletStatistics() const {
+        return _totalMeshlets;
+    }
 
-        Matrix matRotY(4, std::vector<float>({
-            cosf(_fYaw), 0, sinf(_fYaw), 0,
-            0, 1 ,0, 0,
-            -sinf(_fYaw), 0, cosf(_fYaw), 0,
-            0, 0, 0, 1
-        }));
+    const MemoryStatistics &GameEngine::getFrameMemoryStatistics() const {
+        return _frameMemory;
+    }
+
+    void GameEngine::setStrictMemoryMode(bool strict) {
+        _strictMemory = strict;
+    }
+
+    void GameEngine::recordInput(const std::string &path) {
+        _recorder.emplace(path);
+    }
+
+    void GameEngine::replayInput(const std::string &path) {
+        _replay.emplace(path);
+        _setCameraState(_replay->getInitialCamera());
+    }
 
+    CameraState GameEngine::_getCameraState() const {
+        return {_vCamera.getX(), _vCamera.getY(), _vCamera.getZ(), _fYaw, _fTheta};
+    }
+
+    void GameEngine::_setCameraState(const CameraState &camera) {
+        _vCamera = Vec3DGraphic(camera.x, camera.y, camera.z);
+        _fYaw = camera.yaw;
+        _fTheta = camera.theta;
+        // W/S movement in the next frame's events reads the direction before _update refreshes it.
+        _updateLookDirection();
+    }
+
+    void GameEngine::_updateLookDirection() {
+        // Forward axis rotated by the yaw around Y.
+        _lookDirection = Vec3DGraphic(-sinf(_fYaw), 0.f, cosf(_fYaw));
+    }
+
+    void GameEngine::compressMeshes(bool encodeNormals) {
+        for(auto &object : _objects) {
+            object.compress(encodeNormals);
+        }
+    }
+
+    void GameEngine::dumpMemory(std::ostream &out) const {
+        MemoryTracker::dump(out);
+        size_t meshBytes = 0;
+        for(size_t i = 0; i < _objects.size(); ++i) {
+            size_t bytes = _objects[i].getResidentBytes();
+            out << "mesh " << i << ": " << _objects[i].getTriangleCount() << " triangles, " << bytes << " bytes"
+                << (_objects[i].isCompressed() ? " (compressed)" : "") << std::endl;
+            meshBytes += bytes;
+        }
+        out << "meshes: " << meshBytes << " bytes resident" << std::endl;
+    }
+
+    void GameEngine::_update(float elapsedTime)
+    {
+        {
+            // Event handling includes the camera collision ray casts.
+            MemoryScope inputScope(MemorySubsystem::Input);
+            _manageEvents(elapsedTime);
+        }
+         _fTheta += 0.1F * elapsedTime;
 
-        Matrix translationMatrix = Matrix::getIdentityMatrix(4);
-        translationMatrix.set(3, 2, 16.f);
-        Matrix worldMatrix = matRotZ * matRotX;
-        worldMatrix = worldMatrix * translationMatrix;
+        MemoryScope geometryScope(MemorySubsystem::Geometry);
 
-//        Matrix worldMatrix = translationMatrix;
+        // Rotate around Z, then around X at half speed.
+        Quaternion rotation = Quaternion::fromAxisAngle(1.f, 0.f, 0.f, _fTheta * 0.5f) * Quaternion::fromAxisAngle(0.f, 0.f, 1.f, _fTheta);
+        _sceneGraph.setRotation(_modelNode, rotation);
+        _sceneGraph.update();
 
         Vec3DGraphic vUp = Vec3DGraphic(0, 1, 0);
-        Vec3DGraphic vTarget = Vec3DGraphic(0, 0, 1);
 
-        _lookDirection = Vec3DGraphic( vTarget * matRotY);
+        _updateLookDirection();
 
-        vTarget = Vec3DGraphic(_vCamera + _lookDirection);
+        Vec3DGraphic vTarget = Vec3DGraphic(_vCamera + _lookDirection);
 
 
         Matrix cameraMatrix = computePointAtMatrix(_vCamera, vTarget, vUp);
 
         Matrix viewMatrix = computeLookAtMatrix(cameraMatrix);
 
-        sf::VertexArray trianglesToDraw = sf::VertexArray(sf::Triangles, 3 * _cube.getTriangles().size());
         std::vector<Triangle3D> trianglesToRaster = std::vector<Triangle3D>();
         float rescaleFactor = 0.5f * static_cast<float>(_screenWidth);
 
-        for(const auto & triangleMesh : _cube.getTriangles()) {
-            Triangle3D triangle = triangleMesh * worldMatrix;
+        if(_mouseMoved) {
+            _pick(cameraMatrix, rescaleFactor);
+            _mouseMoved = false;
+        }
+
+        std::vector<Matrix> worldMatrices = std::vector<Matrix>();
+        std::vector<Matrix> worldViewMatrices = std::vector<Matrix>();
+        std::vector<std::pair<float, size_t>> objectsByCoverage = std::vector<std::pair<float, size_t>>();
+        for(size_t i = 0; i < _objects.size(); ++i) {
+            worldMatrices.push_back(_sceneGraph.getWorldMatrix(_objectNodes[i]));
+            worldViewMatrices.push_back(worldMatrices.back() * viewMatrix);
+            objectsByCoverage.emplace_back(_estimateScreenCoverage(_objects[i], worldViewMatrices.back(), rescaleFactor), i);
+        }
+        size_t occluderCount = std::min(OCCLUDER_COUNT, objectsByCoverage.size());
+        std::partial_sort(objectsByCoverage.begin(), objectsByCoverage.begin() + static_cast<long>(occluderCount), objectsByCoverage.end(),
+                          [](const auto &object1, const auto &object2) {
+            return object1.first > object2.first;
+        });
 
-            Vec3DGraphic normal = triangle.getNormal();
-            Vec3DGraphic p1AdjustedWithCamera = Vec3DGraphic(triangle.getP1() - _vCamera);
-            if(normal.dot(p1AdjustedWithCamera) < 0.f){
-                Vec3DGraphic lightDirection = Vec3DGraphic(0.f, 0.f, -1.f);
-                lightDirection.normalize();
-                Triangle3D triangleProjected = (triangle * viewMatrix * _projectionMatrix).translate(1.0f, 1.0f, 0.0f) * rescaleFactor;
-                triangleProjected.setLight(lightDirection.dot(normal) * 255.f);
-                trianglesToRaster.push_back(triangleProjected);
+        // The largest on-screen objects are drawn unconditionally and feed the depth pyramid the others are tested against.
+        _frameOcclusion = OcclusionStatistics();
+        _frameMeshlets = MeshletStatistics();
+        _depthPyramid.clear();
+        for(size_t i = 0; i < occluderCount; ++i) {
+            size_t index = objectsByCoverage[i].second;
+            _appendVisibleTriangles(_objects[index], worldMatrices[index], viewMatrix, rescaleFactor, true, trianglesToRaster);
+        }
+        _depthPyramid.build();
+
+        for(size_t i = occluderCount; i < objectsByCoverage.size(); ++i) {
+            size_t index = objectsByCoverage[i].second;
+            const Mesh &object = _objects[index];
+            ++_frameOcclusion.objectsTested;
+            if(_isOccluded(object, worldViewMatrices[index], rescaleFactor)) {
+                ++_frameOcclusion.objectsRejected;
+                _frameOcclusion.trianglesRejected += object.getTriangleCount();
+                continue;
             }
+            _appendVisibleTriangles(object, worldMatrices[index], viewMatrix, rescaleFactor, false, trianglesToRaster);
         }
+        _totalOcclusion += _frameOcclusion;
+        _totalMeshlets += _frameMeshlets;
 
         std::sort(trianglesToRaster.begin(), trianglesToRaster.end(), [](const auto &triangle1, const auto &triangle2) {
             return triangle1.getZMean() < triangle2.getZMean();
         });
 
-
+        MemoryScope renderScope(MemorySubsystem::RenderSubmission);
+        sf::VertexArray trianglesToDraw = sf::VertexArray(sf::Triangles, 3 * trianglesToRaster.size());
         for(int i = 0; i < trianglesToRaster.size(); ++i) {
             Triangle3D triangle = trianglesToRaster[i];
             const Vec3DGraphic& p1 = triangle.getP1();
@@ -136,57 +307,278 @@ namespace engine {
         _window.display();
     }
 
+    void GameEngine::_appendVisibleTriangles(const Mesh &object, const Matrix &worldMatrix, const Matrix &viewMatrix,
+                                             float rescaleFactor, bool isOccluder, std::vector<Triangle3D> &trianglesToRaster)
+    {
+        if(object.isCompressed()) {
+            object.transformVertices(worldMatrix, _transformedVertices);
+        }
+        const std::vector<uint32_t> &indices = object.getIndices();
+        const VertexBuffer &v = _transformedVertices;
+        bool isPickedObject = _pickedObject < _objects.size() && &_objects[_pickedObject] == &object;
+        auto appendTriangle = [&](const Triangle3D &triangle, const Vec3DGraphic &normal, size_t t) {
+            if(_appendTriangle(triangle, normal, viewMatrix, rescaleFactor, isOccluder, trianglesToRaster) && isPickedObject && t == _pickedTriangle) {
+                trianglesToRaster.back().setLight(255.f);
+            }
+        };
+
+        for(const auto &meshlet : object.getMeshlets()) {
+            ++_frameMeshlets.meshletsTested;
+            if(_isMeshletCulled(meshlet, worldMatrix, viewMatrix)) {
+                ++_frameMeshlets.meshletsRejected;
+                _frameMeshlets.trianglesRejected += meshlet.triangleCount;
+                continue;
+            }
+
+            size_t end = meshlet.firstTriangle + meshlet.triangleCount;
+            for(size_t t = meshlet.firstTriangle; t < end; ++t) {
+                if(!object.isCompressed()) {
+                    Triangle3D triangle = object.getTriangles()[t] * worldMatrix;
+                    appendTriangle(triangle, triangle.getNormal(), t);
+                    continue;
+                }
+
+                uint32_t i1 = indices[3 * t], i2 = indices[3 * t + 1], i3 = indices[3 * t + 2];
+                Triangle3D triangle = Triangle3D(
+                    Vec3DGraphic(v.x[i1], v.y[i1], v.z[i1]),
+                    Vec3DGraphic(v.x[i2], v.y[i2], v.z[i2]),
+                    Vec3DGraphic(v.x[i3], v.y[i3], v.z[i3]));
+                if(object.hasEncodedNormals()) {
+                    Vec3DGraphic normal = object.decodeNormal(t).multiplyByMatrix(worldMatrix);
+                    normal.normalize();
+                    appendTriangle(triangle, normal, t);
+                }
+                else {
+                    appendTriangle(triangle, triangle.getNormal(), t);
+                }
+            }
+        }
+    }
+
+    bool GameEngine::_isMeshletCulled(const Meshlet &meshlet, const Matrix &worldMatrix, const Matrix &viewMatrix) const
+    {
+        Vec3DGraphic center = Vec3DGraphic(meshlet.centerX, meshlet.centerY, meshlet.centerZ).multiplyByMatrix(worldMatrix);
+
+        // Every triangle faces away when the whole sphere sits behind the cone, see _appendTriangle's facing test.
+        if(meshlet.coneCutoff < 1.f) {
+            Vec3DGraphic axis = Vec3DGraphic(meshlet.coneAxisX, meshlet.coneAxisY, meshlet.coneAxisZ, 0.f).multiplyByMatrix(worldMatrix);
+            Vec3DGraphic toCenter = Vec3DGraphic(center - _vCamera);
+            if(toCenter.dot(axis) >= meshlet.coneCutoff * toCenter.getNorm() + meshlet.radius) {
+                return true;
+            }
+        }
+
+        Vec3DGraphic viewed = center.multiplyByMatrix(viewMatrix);
+        if(viewed.getZ() + meshlet.radius < Z_NEAR) {
+            return true;
+        }
+        // Side planes |slope * x| <= z, with slopes taken from the projection.
+        float slopeX = std::fabs(_projectionMatrix.at(0, 0));
+        float slopeY = std::fabs(_projectionMatrix.at(1, 1));
+        float distanceX = (slopeX * std::fabs(viewed.getX()) - viewed.getZ()) / sqrtf(slopeX * slopeX + 1.f);
+        float distanceY = (slopeY * std::fabs(viewed.getY()) - viewed.getZ()) / sqrtf(slopeY * slopeY + 1.f);
+        return distanceX > meshlet.radius || distanceY > meshlet.radius;
+    }
+
+    bool GameEngine::_appendTriangle(const Triangle3D &triangle, const Vec3DGraphic &normal, const Matrix &viewMatrix,
+                                     float rescaleFactor, bool isOccluder, std::vector<Triangle3D> &trianglesToRaster)
+    {
+        Vec3DGraphic p1AdjustedWithCamera = Vec3DGraphic(triangle.getP1() - _vCamera);
+        if(normal.dot(p1AdjustedWithCamera) >= 0.f){
+            return false;
+        }
+        Vec3DGraphic lightDirection = Vec3DGraphic(0.f, 0.f, -1.f);
+        lightDirection.normalize();
+        Triangle3D triangleViewed = triangle * viewMatrix;
+        Triangle3D triangleProjected = (triangleViewed * _projectionMatrix).translate(1.0f, 1.0f, 0.0f) * rescaleFactor;
+        triangleProjected.setLight(lightDirection.dot(normal) * 255.f);
+        trianglesToRaster.push_back(triangleProjected);
+
+        float nearestDepth = std::min({triangleViewed.getP1().getZ(), triangleViewed.getP2().getZ(), triangleViewed.getP3().getZ()});
+        float farthestDepth = std::max({triangleViewed.getP1().getZ(), triangleViewed.getP2().getZ(), triangleViewed.getP3().getZ()});
+        if(isOccluder && nearestDepth > Z_NEAR) {
+            _depthPyramid.rasterizeOccluder(triangleProjected, farthestDepth);
+        }
+        return true;
+    }
+
+    Ray GameEngine::computeLocalRay(const Vec3DGraphic &origin, const Vec3DGraphic &direction, const Matrix &inverseWorld, float maxDistance)
+    {
+        Vec3DGraphic localOrigin = origin.multiplyByMatrix(inverseWorld);
+        Vec3DGraphic localDirection = Vec3DGraphic(direction.getX(), direction.getY(), direction.getZ(), 0.f).multiplyByMatrix(inverseWorld);
+        return {
+            localOrigin.getX(), localOrigin.getY(), localOrigin.getZ(),
+            localDirection.getX(), localDirection.getY(), localDirection.getZ(),
+            maxDistance
+        };
+    }
+
+    bool GameEngine::castRay(const Vec3DGraphic &origin, const Vec3DGraphic &direction, float maxDistance, size_t &object, RayHit &hit) const
+    {
+        bool found = false;
+        for(size_t i = 0; i < _objects.size(); ++i) {
+            Matrix inverseWorld = _sceneGraph.getWorldMatrix(_objectNodes[i]).getAffineInverse();
+            Ray ray = computeLocalRay(origin, direction, inverseWorld, maxDistance);
+            // Affine transforms keep the ray parameter, so distances compare across objects.
+            if(_objects[i].getBVH().intersectClosest(_objects[i], ray, hit)) {
+                object = i;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    void GameEngine::_pick(const Matrix &cameraMatrix, float rescaleFactor)
+    {
+        // Back from screen pixels to a view space direction on the z = 1 plane, then to world space.
+        float projectedX = static_cast<float>(_mouseX) / rescaleFactor - 1.f;
+        float projectedY = static_cast<float>(_mouseY) / rescaleFactor - 1.f;
+        Vec3DGraphic viewDirection = Vec3DGraphic(projectedX / _projectionMatrix.at(0, 0), projectedY / _projectionMatrix.at(1, 1), 1.f, 0.f);
+        Vec3DGraphic direction = viewDirection.multiplyByMatrix(cameraMatrix);
+
+        _pickedObject = SIZE_MAX;
+        _pickedTriangle = UINT32_MAX;
+        RayHit hit;
+        if(castRay(_vCamera, direction, INFINITY, _pickedObject, hit)) {
+            _pickedTriangle = hit.triangle;
+        }
+    }
+
+    void GameEngine::_moveCamera(const Vec3DGraphic &target)
+    {
+        Vec3DGraphic movement = Vec3DGraphic(target - _vCamera);
+        float length = movement.getNorm();
+        if(length == 0.f) {
+            return;
+        }
+        Vec3DGraphic direction = Vec3DGraphic(movement * (1.f / length));
+
+        // Stop the camera short of the first surface along the way.
+        size_t object;
+        RayHit hit;
+        float allowed = length;
+        if(castRay(_vCamera, direction, length + CAMERA_RADIUS, object, hit)) {
+            allowed = std::max(0.f, hit.distance - CAMERA_RADIUS);
+        }
+        _vCamera = _vCamera.translate(direction.getX() * allowed, direction.getY() * allowed, direction.getZ() * allowed);
+    }
+
+    float GameEngine::_estimateScreenCoverage(const Mesh &object, const Matrix &worldViewMatrix, float rescaleFactor) const
+    {
+        Vec3DGraphic center = Vec3DGraphic(Vec3DGraphic(object.getBoundsMin() + object.getBoundsMax()) * 0.5f);
+        Vec3DGraphic viewed = center.multiplyByMatrix(worldViewMatrix);
+        if(viewed.getZ() <= Z_NEAR) {
+            return 0.f;
+        }
+        Vec3DGraphic projected = Vec3DGraphic(viewed.multiplyByMatrix(_projectionMatrix).translate(1.0f, 1.0f, 0.0f) * rescaleFactor);
+        if(projected.getX() < 0.f || projected.getX() > static_cast<float>(_screenWidth)
+           || projected.getY() < 0.f || projected.getY() > static_cast<float>(_screenHeight)) {
+            return 0.f;
+        }
+        float radius = 0.5f * Vec3DGraphic(object.getBoundsMax() - object.getBoundsMin()).getNorm();
+        return radius / viewed.getZ();
+    }
+
+    bool GameEngine::_isOccluded(const Mesh &object, const Matrix &worldViewMatrix, float rescaleFactor) const
+    {
+        const Vec3DGraphic &bMin = object.getBoundsMin();
+        const Vec3DGraphic &bMax = object.getBoundsMax();
+        float minX = INFINITY, minY = INFINITY, nearestDepth = INFINITY;
+        float maxX = -INFINITY, maxY = -INFINITY;
+
+        for(int corner = 0; corner < 8; ++corner) {
+            Vec3DGraphic point = Vec3DGraphic(
+                (corner & 1) ? bMax.getX() : bMin.getX(),
+                (corner & 2) ? bMax.getY() : bMin.getY(),
+                (corner & 4) ? bMax.getZ() : bMin.getZ());
+            Vec3DGraphic viewed = point.multiplyByMatrix(worldViewMatrix);
+            // A box crossing the near plane can't be projected safely, keep it.
+            if(viewed.getZ() <= Z_NEAR) {
+                return false;
+            }
+            Vec3DGraphic projected = Vec3DGraphic(viewed.multiplyByMatrix(_projectionMatrix).translate(1.0f, 1.0f, 0.0f) * rescaleFactor);
+            minX = std::min(minX, projected.getX());
+            minY = std::min(minY, projected.getY());
+            nearestDepth = std::min(nearestDepth, viewed.getZ());
+            maxX = std::max(maxX, projected.getX());
+            maxY = std::max(maxY, projected.getY());
+        }
+        return _depthPyramid.isOccluded(minX, minY, maxX, maxY, nearestDepth);
+    }
+
     void GameEngine::_manageEvents(float elapsedTime)
     {
         sf::Event event{};
 
         while (_window.pollEvent(event))
         {
-            if (event.type == sf::Event::Closed)
+            // Live input is ignored while replaying, except for closing the window.
+            if(_replay && event.type != sf::Event::Closed) {
+                continue;
+            }
+            _handleEvent(event, elapsedTime);
+            if(_recorder) {
+                _recorder->recordEvent(event);
+            }
+        }
+        if(_replay) {
+            for(const sf::Event &recordedEvent : _replay->getFrame(_frameCount).events) {
+                _handleEvent(recordedEvent, elapsedTime);
+                if(_recorder) {
+                    _recorder->recordEvent(recordedEvent);
+                }
+            }
+        }
+    }
+
+    void GameEngine::_handleEvent(const sf::Event &event, float elapsedTime)
+    {
+        if (event.type == sf::Event::Closed)
+        {
+            _window.close();
+        }
+        else if(event.type == sf::Event::KeyPressed)
+        {
+            if(event.key.scancode == sf::Keyboard::Scan::Down)
             {
-                _window.close();
+                _moveCamera(_vCamera.translate(0.f, -8.f * elapsedTime, 0.f));
             }
-            else if(event.type == sf::Event::KeyPressed)
+            else if(event.key.scancode == sf::Keyboard::Scan::Up)
             {
-                if(event.key.scancode == sf::Keyboard::Scan::Down)
-                {
-                    _vCamera.setY(_vCamera.getY() - 8.f * elapsedTime);
-                }
-                else if(event.key.scancode == sf::Keyboard::Scan::Up)
-                {
-                    _vCamera.setY(_vCamera.getY() + 8.f * elapsedTime);
-                }
-                else if(event.key.scancode == sf::Keyboard::Scan::Right)
-                {
-                    _vCamera.setX(_vCamera.getX() - 8.f * elapsedTime);
-                }
-                else if(event.key.scancode == sf::Keyboard::Scan::Left)
-                {
-                    _vCamera.setX(_vCamera.getX() + 8.f * elapsedTime);
-                }
-                else if(event.key.scancode == sf::Keyboard::Scan::A)
-                {
-                    _fYaw -= 0.5f * elapsedTime;
-                }
-                else if(event.key.scancode == sf::Keyboard::Scan::D)
-                {
-                    _fYaw += 0.5f * elapsedTime;
-                }
-                else if(event.key.scancode == sf::Keyboard::Scan::W)
-                {
-                    Vec3DGraphic vForward = Vec3DGraphic(_lookDirection * 8.f * elapsedTime);
-                    _vCamera = Vec3DGraphic(_vCamera + vForward);
-                }
-                else if(event.key.scancode == sf::Keyboard::Scan::S)
-                {
-                    Vec3DGraphic vForward = Vec3DGraphic(_lookDirection * 8.f * elapsedTime);
-                    _vCamera = Vec3DGraphic(_vCamera - vForward);
-                }
+                _moveCamera(_vCamera.translate(0.f, 8.f * elapsedTime, 0.f));
             }
-            else if (event.type == sf::Event::MouseMoved)
+            else if(event.key.scancode == sf::Keyboard::Scan::Right)
             {
-
+                _moveCamera(_vCamera.translate(-8.f * elapsedTime, 0.f, 0.f));
+            }
+            else if(event.key.scancode == sf::Keyboard::Scan::Left)
+            {
+                _moveCamera(_vCamera.translate(8.f * elapsedTime, 0.f, 0.f));
+            }
+            else if(event.key.scancode == sf::Keyboard::Scan::A)
+            {
+                _fYaw -= 0.5f * elapsedTime;
+            }
+            else if(event.key.scancode == sf::Keyboard::Scan::D)
+            {
+                _fYaw += 0.5f * elapsedTime;
+            }
+            else if(event.key.scancode == sf::Keyboard::Scan::W)
+            {
+                Vec3DGraphic vForward = Vec3DGraphic(_lookDirection * 8.f * elapsedTime);
+                _moveCamera(Vec3DGraphic(_vCamera + vForward));
             }
+            else if(event.key.scancode == sf::Keyboard::Scan::S)
+            {
+                Vec3DGraphic vForward = Vec3DGraphic(_lookDirection * 8.f * elapsedTime);
+                _moveCamera(Vec3DGraphic(_vCamera - vForward));
+            }
+        }
+        else if (event.type == sf::Event::MouseMoved)
+        {
+            _mouseX = event.mouseMove.x;
+            _mouseY = event.mouseMove.y;
+            _mouseMoved = true;
         }
     }
 
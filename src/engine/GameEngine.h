@@ -8,10 +8,35 @@
 #include <ctime>
 #include <cstdint>
 #include <iostream>
+#include <optional>
 #include "shapes/Mesh.h"
+#include "HierarchicalZBuffer.h"
+#include "InputLog.h"
+#include "MemoryTracker.h"
+#include "SceneGraph.h"
 
 namespace engine {
 
+    struct OcclusionStatistics {
+        size_t objectsTested = 0;
+
+        size_t objectsRejected = 0;
+
+        size_t trianglesRejected = 0;
+
+        OcclusionStatistics &operator+=(const OcclusionStatistics &other);
+    };
+
+    struct MeshletStatistics {
+        size_t meshletsTested = 0;
+
+        size_t meshletsRejected = 0;
+
+        size_t trianglesRejected = 0;
+
+        MeshletStatistics &operator+=(const MeshletStatistics &other);
+    };
+
 
 class GameEngineException : public std::runtime_error {};
 
@@ -25,11 +50,53 @@ class GameEngineException : public std::runtime_error {};
 
         unsigned int _screenWidth;
 
+        unsigned int _screenHeight;
+
         sf::RenderWindow _window;
 
         Matrix _projectionMatrix;
 
-        Mesh _cube;
+        std::vector<Mesh> _objects;
+
+        SceneGraph _sceneGraph;
+
+        SceneGraph::NodeId _modelNode;
+
+        std::vector<SceneGraph::NodeId> _objectNodes;
+
+        HierarchicalZBuffer _depthPyramid;
+
+        OcclusionStatistics _frameOcclusion;
+
+        OcclusionStatistics _totalOcclusion;
+
+        MeshletStatistics _frameMeshlets;
+
+        MeshletStatistics _totalMeshlets;
+
+        bool _strictMemory = false;
+
+        size_t _frameCount = 0;
+
+        MemoryStatistics _frameMemory;
+
+        VertexBuffer _transformedVertices;
+
+        bool _mouseMoved = false;
+
+        int _mouseX = 0;
+
+        int _mouseY = 0;
+
+        size_t _pickedObject = SIZE_MAX;
+
+        uint32_t _pickedTriangle = UINT32_MAX;
+
+        std::optional<InputRecorder> _recorder;
+
+        std::optional<InputReplay> _replay;
+
+        size_t _replayDivergedFrames = 0;
 
         float _fTheta = 0.0f;
 
@@ -43,14 +110,63 @@ class GameEngineException : public std::runtime_error {};
 
         void _manageEvents(float elapsedTime);
 
+        void _handleEvent(const sf::Event &event, float elapsedTime);
+
+        [[nodiscard]] CameraState _getCameraState() const;
+
+        void _setCameraState(const CameraState &camera);
+
+        void _updateLookDirection();
+
+        void _appendVisibleTriangles(const Mesh &object, const Matrix &worldMatrix, const Matrix &viewMatrix,
+                                     float rescaleFactor, bool isOccluder, std::vector<Triangle3D> &trianglesToRaster);
+
+        void _pick(const Matrix &cameraMatrix, float rescaleFactor);
+
+        void _moveCamera(const Vec3DGraphic &target);
+
+        bool _isMeshletCulled(const Meshlet &meshlet, const Matrix &worldMatrix, const Matrix &viewMatrix) const;
+
+        bool _appendTriangle(const Triangle3D &triangle, const Vec3DGraphic &normal, const Matrix &viewMatrix,
+                             float rescaleFactor, bool isOccluder, std::vector<Triangle3D> &trianglesToRaster);
+
+        float _estimateScreenCoverage(const Mesh &object, const Matrix &worldViewMatrix, float rescaleFactor) const;
+
+        bool _isOccluded(const Mesh &object, const Matrix &worldViewMatrix, float rescaleFactor) const;
+
     public:
-        void startLoop();
+        // Returns false when strict memory mode caught a steady-state allocation.
+        bool startLoop();
+
+        [[nodiscard]] const OcclusionStatistics &getFrameOcclusionStatistics() const;
+
+        [[nodiscard]] const OcclusionStatistics &getTotalOcclusionStatistics() const;
+
+        [[nodiscard]] const MeshletStatistics &getFrameMeshletStatistics() const;
+
+        [[nodiscard]] const MeshletStatistics &getTotalMeshletStatistics() const;
+
+        [[nodiscard]] const MemoryStatistics &getFrameMemoryStatistics() const;
+
+        void setStrictMemoryMode(bool strict);
+
+        void compressMeshes(bool encodeNormals);
+
+        void dumpMemory(std::ostream &out) const;
+
+        void recordInput(const std::string &path);
+
+        void replayInput(const std::string &path);
 
         static Matrix _computeProjectionMatrix(unsigned int width, unsigned int height);
 
         static Matrix computePointAtMatrix(const Vec3DGraphic &pos, const Vec3DGraphic &target, const Vec3DGraphic &up);
 
         static Matrix computeLookAtMatrix(const Matrix &m);
+
+        static Ray computeLocalRay(const Vec3DGraphic &origin, const Vec3DGraphic &direction, const Matrix &inverseWorld, float maxDistance);
+
+        [[nodiscard]] bool castRay(const Vec3DGraphic &origin, const Vec3DGraphic &direction, float maxDistance, size_t &object, RayHit &hit) const;
     };
 
 } // engine
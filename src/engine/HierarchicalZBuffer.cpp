@@ -0,0 +1,146 @@
+//
+// Created by Maxime Boulanger on 2023-12-02.
+//
+
+#include "HierarchicalZBuffer.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace engine {
+    static const float FAR_DEPTH = std::numeric_limits<float>::infinity();
+
+    HierarchicalZBuffer::HierarchicalZBuffer(unsigned int screenWidth, unsigned int screenHeight, unsigned int texelSize) :
+            _texelSize(texelSize),
+            _pixelWidth(screenWidth),
+            _pixelHeight(screenHeight),
+            _pixelDepths(_pixelWidth * _pixelHeight, FAR_DEPTH),
+            _screenWidth(static_cast<float>(screenWidth)),
+            _screenHeight(static_cast<float>(screenHeight))
+    {
+        size_t width = (screenWidth + texelSize - 1) / texelSize;
+        size_t height = (screenHeight + texelSize - 1) / texelSize;
+        while(true) {
+            _levels.push_back({width, height, std::vector<float>(width * height, FAR_DEPTH)});
+            if(width == 1 && height == 1) {
+                break;
+            }
+            width = (width + 1) / 2;
+            height = (height + 1) / 2;
+        }
+    }
+
+    void HierarchicalZBuffer::clear() {
+        std::fill(_pixelDepths.begin(), _pixelDepths.end(), FAR_DEPTH);
+        for(auto &level : _levels) {
+            std::fill(level.depths.begin(), level.depths.end(), FAR_DEPTH);
+        }
+    }
+
+    void HierarchicalZBuffer::rasterizeOccluder(const Triangle3D &screenTriangle, float farthestDepth) {
+        float x1 = screenTriangle.getP1().getX(), y1 = screenTriangle.getP1().getY();
+        float x2 = screenTriangle.getP2().getX(), y2 = screenTriangle.getP2().getY();
+        float x3 = screenTriangle.getP3().getX(), y3 = screenTriangle.getP3().getY();
+
+        float area = (x2 - x1) * (y3 - y1) - (y2 - y1) * (x3 - x1);
+        if(area == 0.f) {
+            return;
+        }
+        auto firstX = static_cast<long>(std::floor(std::min({x1, x2, x3})));
+        auto lastX = static_cast<long>(std::floor(std::max({x1, x2, x3})));
+        auto firstY = static_cast<long>(std::floor(std::min({y1, y2, y3})));
+        auto lastY = static_cast<long>(std::floor(std::max({y1, y2, y3})));
+        firstX = std::max(firstX, 0L);
+        firstY = std::max(firstY, 0L);
+        lastX = std::min(lastX, static_cast<long>(_pixelWidth) - 1);
+        lastY = std::min(lastY, static_cast<long>(_pixelHeight) - 1);
+
+        // Pixels are sampled at their center and edges count as inside, so neighbouring triangles leave no seam.
+        for(long py = firstY; py <= lastY; ++py) {
+            float cy = static_cast<float>(py) + 0.5f;
+            for(long px = firstX; px <= lastX; ++px) {
+                float cx = static_cast<float>(px) + 0.5f;
+                float w1 = (x2 - cx) * (y3 - cy) - (y2 - cy) * (x3 - cx);
+                float w2 = (x3 - cx) * (y1 - cy) - (y3 - cy) * (x1 - cx);
+                float w3 = (x1 - cx) * (y2 - cy) - (y1 - cy) * (x2 - cx);
+                bool inside = area > 0.f ? (w1 >= 0.f && w2 >= 0.f && w3 >= 0.f) : (w1 <= 0.f && w2 <= 0.f && w3 <= 0.f);
+                if(inside) {
+                    float &stored = _pixelDepths[py * _pixelWidth + px];
+                    stored = std::min(stored, farthestDepth);
+                }
+            }
+        }
+    }
+
+    void HierarchicalZBuffer::build() {
+        // Any pixel left uncovered keeps its texel at the far depth, so nothing is culled behind a gap.
+        Level &base = _levels.front();
+        for(size_t ty = 0; ty < base.height; ++ty) {
+            size_t lastPy = std::min((ty + 1) * _texelSize, _pixelHeight);
+            for(size_t tx = 0; tx < base.width; ++tx) {
+                size_t firstPx = tx * _texelSize;
+                size_t lastPx = std::min(firstPx + _texelSize, _pixelWidth);
+                float depth = 0.f;
+                for(size_t py = ty * _texelSize; py < lastPy; ++py) {
+                    const float *row = &_pixelDepths[py * _pixelWidth];
+                    depth = std::max(depth, *std::max_element(row + firstPx, row + lastPx));
+                }
+                base.depths[ty * base.width + tx] = depth;
+            }
+        }
+
+        for(size_t l = 1; l < _levels.size(); ++l) {
+            const Level &child = _levels[l - 1];
+            Level &parent = _levels[l];
+            for(size_t y = 0; y < parent.height; ++y) {
+                size_t cy0 = 2 * y;
+                size_t cy1 = std::min(cy0 + 1, child.height - 1);
+                for(size_t x = 0; x < parent.width; ++x) {
+                    size_t cx0 = 2 * x;
+                    size_t cx1 = std::min(cx0 + 1, child.width - 1);
+                    parent.depths[y * parent.width + x] = std::max({
+                        child.depths[cy0 * child.width + cx0],
+                        child.depths[cy0 * child.width + cx1],
+                        child.depths[cy1 * child.width + cx0],
+                        child.depths[cy1 * child.width + cx1]
+                    });
+                }
+            }
+        }
+    }
+
+    bool HierarchicalZBuffer::isOccluded(float minX, float minY, float maxX, float maxY, float nearestDepth) const {
+        minX = std::max(minX, 0.f);
+        minY = std::max(minY, 0.f);
+        maxX = std::min(maxX, _screenWidth - 1.f);
+        maxY = std::min(maxY, _screenHeight - 1.f);
+        if(minX > maxX || minY > maxY) {
+            return false;
+        }
+
+        // Pick the level where the rectangle spans at most two texels on each axis.
+        float extent = std::max(maxX - minX, maxY - minY) / static_cast<float>(_texelSize);
+        size_t level = extent > 1.f ? static_cast<size_t>(std::ceil(std::log2(extent))) : 0;
+        level = std::min(level, _levels.size() - 1);
+
+        const Level &l = _levels[level];
+        float levelTexel = static_cast<float>(_texelSize << level);
+        size_t firstX = static_cast<size_t>(minX / levelTexel);
+        size_t lastX = std::min(static_cast<size_t>(maxX / levelTexel), l.width - 1);
+        size_t firstY = static_cast<size_t>(minY / levelTexel);
+        size_t lastY = std::min(static_cast<size_t>(maxY / levelTexel), l.height - 1);
+
+        for(size_t y = firstY; y <= lastY; ++y) {
+            for(size_t x = firstX; x <= lastX; ++x) {
+                if(l.depths[y * l.width + x] >= nearestDepth) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    size_t HierarchicalZBuffer::levels() const {
+        return _levels.size();
+    }
+} // engine
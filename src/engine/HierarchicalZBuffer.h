@@ -0,0 +1,55 @@
+//
+// Created by Maxime Boulanger on 2023-12-02.
+//
+
+#ifndef INC_3DGRAPHICSENGINE_HIERARCHICALZBUFFER_H
+#define INC_3DGRAPHICSENGINE_HIERARCHICALZBUFFER_H
+
+#include <cstddef>
+#include <vector>
+#include "shapes/Triangle3D.h"
+
+namespace engine {
+
+    // Depths are view space distances. Occluders are rasterized per pixel, keeping the nearest occluder depth of each pixel.
+    // Level 0 keeps the farthest depth of the pixels in each texel, so a texel is only set once occluders cover all of it,
+    // each next level the farthest depth of its 4 children.
+    class HierarchicalZBuffer {
+    public:
+        HierarchicalZBuffer(unsigned int screenWidth, unsigned int screenHeight, unsigned int texelSize);
+
+        void clear();
+
+        void rasterizeOccluder(const Triangle3D &screenTriangle, float farthestDepth);
+
+        void build();
+
+        [[nodiscard]] bool isOccluded(float minX, float minY, float maxX, float maxY, float nearestDepth) const;
+
+        [[nodiscard]] size_t levels() const;
+
+    private:
+        struct Level {
+            size_t width;
+            size_t height;
+            std::vector<float> depths;
+        };
+
+        unsigned int _texelSize;
+
+        size_t _pixelWidth;
+
+        size_t _pixelHeight;
+
+        std::vector<float> _pixelDepths;
+
+        float _screenWidth;
+
+        float _screenHeight;
+
+        std::vector<Level> _levels;
+    };
+
+} // engine
+
+#endif //INC_3DGRAPHICSENGINE_HIERARCHICALZBUFFER_H
@@ -0,0 +1,141 @@
+//
+// Created by Maxime Boulanger on 2023-12-15.
+//
+
+#include <stdexcept>
+#include "InputLog.h"
+
+namespace engine {
+    static const uint32_t LOG_MAGIC = 0x474c4e49; // "INLG"
+
+    static const uint16_t LOG_VERSION = 1;
+
+    static const uint8_t EVENT_KEY_PRESSED = 0;
+
+    static const uint8_t EVENT_MOUSE_MOVED = 1;
+
+    // Keeps steady-state recording free of allocations for any realistic number of events per frame.
+    static const size_t RESERVED_EVENTS_PER_FRAME = 64;
+
+    template<typename T>
+    static void writeValue(std::ofstream &out, T value) {
+        out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    static T readValue(std::ifstream &in) {
+        T value;
+        if(!in.read(reinterpret_cast<char *>(&value), sizeof(T))) {
+            throw std::runtime_error("Input log is truncated");
+        }
+        return value;
+    }
+
+    static void writeCamera(std::ofstream &out, const CameraState &camera) {
+        writeValue(out, camera.x);
+        writeValue(out, camera.y);
+        writeValue(out, camera.z);
+        writeValue(out, camera.yaw);
+        writeValue(out, camera.theta);
+    }
+
+    static CameraState readCamera(std::ifstream &in) {
+        CameraState camera;
+        camera.x = readValue<float>(in);
+        camera.y = readValue<float>(in);
+        camera.z = readValue<float>(in);
+        camera.yaw = readValue<float>(in);
+        camera.theta = readValue<float>(in);
+        return camera;
+    }
+
+    InputRecorder::InputRecorder(const std::string &path) : _out(path, std::ios::binary) {
+        if(!_out) {
+            throw std::runtime_error("Can't open " + path);
+        }
+        _frame.events.reserve(RESERVED_EVENTS_PER_FRAME);
+    }
+
+    void InputRecorder::start(const CameraState &initialCamera) {
+        writeValue(_out, LOG_MAGIC);
+        writeValue(_out, LOG_VERSION);
+        writeCamera(_out, initialCamera);
+    }
+
+    void InputRecorder::beginFrame(uint16_t stepMilliseconds) {
+        _frame.stepMilliseconds = stepMilliseconds;
+        _frame.events.clear();
+    }
+
+    void InputRecorder::recordEvent(const sf::Event &event) {
+        if(event.type == sf::Event::KeyPressed || event.type == sf::Event::MouseMoved) {
+            _frame.events.push_back(event);
+        }
+    }
+
+    void InputRecorder::endFrame(const CameraState &camera) {
+        writeValue(_out, _frame.stepMilliseconds);
+        writeValue(_out, static_cast<uint16_t>(_frame.events.size()));
+        for(const sf::Event &event : _frame.events) {
+            if(event.type == sf::Event::KeyPressed) {
+                writeValue(_out, EVENT_KEY_PRESSED);
+                writeValue(_out, static_cast<int16_t>(event.key.scancode));
+            }
+            else {
+                writeValue(_out, EVENT_MOUSE_MOVED);
+                writeValue(_out, static_cast<int16_t>(event.mouseMove.x));
+                writeValue(_out, static_cast<int16_t>(event.mouseMove.y));
+            }
+        }
+        writeCamera(_out, camera);
+    }
+
+    InputReplay::InputReplay(const std::string &path) {
+        std::ifstream in(path, std::ios::binary);
+        if(!in) {
+            throw std::runtime_error("Can't open " + path);
+        }
+        if(readValue<uint32_t>(in) != LOG_MAGIC || readValue<uint16_t>(in) != LOG_VERSION) {
+            throw std::runtime_error(path + " is not an input log");
+        }
+        _initialCamera = readCamera(in);
+
+        while(in.peek() != std::ifstream::traits_type::eof()) {
+            InputFrame frame;
+            frame.stepMilliseconds = readValue<uint16_t>(in);
+            auto eventCount = readValue<uint16_t>(in);
+            for(uint16_t i = 0; i < eventCount; ++i) {
+                sf::Event event{};
+                auto type = readValue<uint8_t>(in);
+                if(type == EVENT_KEY_PRESSED) {
+                    event.type = sf::Event::KeyPressed;
+                    event.key.scancode = static_cast<decltype(event.key.scancode)>(readValue<int16_t>(in));
+                }
+                else if(type == EVENT_MOUSE_MOVED) {
+                    event.type = sf::Event::MouseMoved;
+                    event.mouseMove.x = readValue<int16_t>(in);
+                    event.mouseMove.y = readValue<int16_t>(in);
+                }
+                else {
+                    throw std::runtime_error("Unknown event in input log");
+                }
+                frame.events.push_back(event);
+            }
+            frame.camera = readCamera(in);
+            _frames.push_back(frame);
+        }
+    }
+
+    const CameraState &InputReplay::getInitialCamera() const {
+        return _initialCamera;
+    }
+
+    size_t InputReplay::getFrameCount() const {
+        return _frames.size();
+    }
+
+    const InputFrame &InputReplay::getFrame(size_t index) const {
+        return _frames.at(index);
+    }
+
+} // engine
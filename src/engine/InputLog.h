@@ -0,0 +1,80 @@
+//
+// Created by Maxime Boulanger on 2023-12-15.
+//
+
+#ifndef INC_3DGRAPHICSENGINE_INPUTLOG_H
+#define INC_3DGRAPHICSENGINE_INPUTLOG_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <SFML/Window/Event.hpp>
+
+namespace engine {
+
+    struct CameraState {
+        float x = 0.f;
+
+        float y = 0.f;
+
+        float z = 0.f;
+
+        float yaw = 0.f;
+
+        float theta = 0.f;
+
+        bool operator==(const CameraState &other) const = default;
+    };
+
+    struct InputFrame {
+        uint16_t stepMilliseconds = 0;
+
+        std::vector<sf::Event> events;
+
+        // State at the end of the frame, used to check that a replay follows the recorded path.
+        CameraState camera;
+    };
+
+    // Binary log layout: a header (magic, version, initial camera) followed by one record per frame holding the
+    // frame step, its input events and the camera state once the frame is done. Timestamps are the running sum
+    // of the steps. Values are written in host byte order.
+    class InputRecorder {
+    public:
+        explicit InputRecorder(const std::string &path);
+
+        // Writes the header. Called once the starting camera is final, e.g. after a replay has placed it.
+        void start(const CameraState &initialCamera);
+
+        void beginFrame(uint16_t stepMilliseconds);
+
+        // Only the events the engine reacts to are kept, anything else is skipped.
+        void recordEvent(const sf::Event &event);
+
+        void endFrame(const CameraState &camera);
+
+    private:
+        std::ofstream _out;
+
+        InputFrame _frame;
+    };
+
+    class InputReplay {
+    public:
+        explicit InputReplay(const std::string &path);
+
+        [[nodiscard]] const CameraState &getInitialCamera() const;
+
+        [[nodiscard]] size_t getFrameCount() const;
+
+        [[nodiscard]] const InputFrame &getFrame(size_t index) const;
+
+    private:
+        CameraState _initialCamera;
+
+        std::vector<InputFrame> _frames;
+    };
+
+} // engine
+
+#endif //INC_3DGRAPHICSENGINE_INPUTLOG_H
@@ -0,0 +1,238 @@
+//
+// Created by Maxime Boulanger on 2023-12-04.
+//
+
+#include "MemoryTracker.h"
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+
+namespace engine {
+    static const size_t SUBSYSTEM_COUNT = static_cast<size_t>(MemorySubsystem::Count);
+
+    // Placed before every block so deallocation knows its size and owner, keeps malloc's 16 bytes alignment.
+    struct alignas(16) AllocationHeader {
+        size_t bytes;
+        MemorySubsystem subsystem;
+    };
+
+    struct Counters {
+        std::atomic<size_t> allocations{0};
+        std::atomic<size_t> deallocations{0};
+        std::atomic<size_t> bytesAllocated{0};
+        std::atomic<size_t> liveBytes{0};
+        std::atomic<size_t> peakBytes{0};
+        std::atomic<size_t> frameAllocations{0};
+        std::atomic<size_t> frameDeallocations{0};
+        std::atomic<size_t> frameBytesAllocated{0};
+        std::atomic<size_t> framePeakBytes{0};
+    };
+
+    static Counters subsystemCounters[SUBSYSTEM_COUNT];
+
+    static Counters totalCounters;
+
+    static thread_local MemorySubsystem currentSubsystem = MemorySubsystem::Other;
+
+    static void raisePeak(std::atomic<size_t> &peak, size_t value) {
+        size_t current = peak.load(std::memory_order_relaxed);
+        while(value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+    }
+
+    static void add(Counters &counters, size_t bytes) {
+        counters.allocations.fetch_add(1, std::memory_order_relaxed);
+        counters.frameAllocations.fetch_add(1, std::memory_order_relaxed);
+        counters.bytesAllocated.fetch_add(bytes, std::memory_order_relaxed);
+        counters.frameBytesAllocated.fetch_add(bytes, std::memory_order_relaxed);
+        size_t live = counters.liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        raisePeak(counters.peakBytes, live);
+        raisePeak(counters.framePeakBytes, live);
+    }
+
+    static void remove(Counters &counters, size_t bytes) {
+        counters.deallocations.fetch_add(1, std::memory_order_relaxed);
+        counters.frameDeallocations.fetch_add(1, std::memory_order_relaxed);
+        counters.liveBytes.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    static MemoryStatistics snapshot(const Counters &counters) {
+        MemoryStatistics statistics;
+        statistics.allocations = counters.allocations.load(std::memory_order_relaxed);
+        statistics.deallocations = counters.deallocations.load(std::memory_order_relaxed);
+        statistics.bytesAllocated = counters.bytesAllocated.load(std::memory_order_relaxed);
+        statistics.liveBytes = counters.liveBytes.load(std::memory_order_relaxed);
+        statistics.peakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+        return statistics;
+    }
+
+    static MemoryStatistics frameSnapshot(const Counters &counters) {
+        MemoryStatistics statistics;
+        statistics.allocations = counters.frameAllocations.load(std::memory_order_relaxed);
+        statistics.deallocations = counters.frameDeallocations.load(std::memory_order_relaxed);
+        statistics.bytesAllocated = counters.frameBytesAllocated.load(std::memory_order_relaxed);
+        statistics.liveBytes = counters.liveBytes.load(std::memory_order_relaxed);
+        statistics.peakBytes = counters.framePeakBytes.load(std::memory_order_relaxed);
+        return statistics;
+    }
+
+    static void resetFrame(Counters &counters) {
+        counters.frameAllocations.store(0, std::memory_order_relaxed);
+        counters.frameDeallocations.store(0, std::memory_order_relaxed);
+        counters.frameBytesAllocated.store(0, std::memory_order_relaxed);
+        counters.framePeakBytes.store(counters.liveBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    void MemoryTracker::beginFrame() {
+        for(auto &counters : subsystemCounters) {
+            resetFrame(counters);
+        }
+        resetFrame(totalCounters);
+    }
+
+    MemoryStatistics MemoryTracker::endFrame() {
+        return frameSnapshot(totalCounters);
+    }
+
+    MemoryStatistics MemoryTracker::getStatistics(MemorySubsystem subsystem) {
+        return snapshot(subsystemCounters[static_cast<size_t>(subsystem)]);
+    }
+
+    MemoryStatistics MemoryTracker::getFrameStatistics(MemorySubsystem subsystem) {
+        return frameSnapshot(subsystemCounters[static_cast<size_t>(subsystem)]);
+    }
+
+    MemoryStatistics MemoryTracker::getTotalStatistics() {
+        return snapshot(totalCounters);
+    }
+
+    MemorySubsystem MemoryTracker::getCurrentSubsystem() {
+        return currentSubsystem;
+    }
+
+    void MemoryTracker::setCurrentSubsystem(MemorySubsystem subsystem) {
+        currentSubsystem = subsystem;
+    }
+
+    const char *MemoryTracker::getSubsystemName(MemorySubsystem subsystem) {
+        switch(subsystem) {
+            case MemorySubsystem::Loader:
+                return "loader";
+            case MemorySubsystem::MeshStorage:
+                return "mesh storage";
+            case MemorySubsystem::Input:
+                return "input";
+            case MemorySubsystem::Geometry:
+                return "geometry";
+            case MemorySubsystem::RenderSubmission:
+                return "render submission";
+            default:
+                return "other";
+        }
+    }
+
+    void MemoryTracker::dump(std::ostream &out) {
+        out << std::left << std::setw(20) << "subsystem" << std::right
+            << std::setw(14) << "allocations" << std::setw(14) << "bytes"
+            << std::setw(14) << "live bytes" << std::setw(14) << "peak bytes"
+            << std::setw(14) << "frame allocs" << std::setw(14) << "frame bytes" << std::endl;
+        for(size_t i = 0; i < SUBSYSTEM_COUNT; ++i) {
+            auto subsystem = static_cast<MemorySubsystem>(i);
+            MemoryStatistics statistics = getStatistics(subsystem);
+            MemoryStatistics frame = getFrameStatistics(subsystem);
+            out << std::left << std::setw(20) << getSubsystemName(subsystem) << std::right
+                << std::setw(14) << statistics.allocations << std::setw(14) << statistics.bytesAllocated
+                << std::setw(14) << statistics.liveBytes << std::setw(14) << statistics.peakBytes
+                << std::setw(14) << frame.allocations << std::setw(14) << frame.bytesAllocated << std::endl;
+        }
+        MemoryStatistics total = getTotalStatistics();
+        MemoryStatistics frame = frameSnapshot(totalCounters);
+        out << std::left << std::setw(20) << "total" << std::right
+            << std::setw(14) << total.allocations << std::setw(14) << total.bytesAllocated
+            << std::setw(14) << total.liveBytes << std::setw(14) << total.peakBytes
+            << std::setw(14) << frame.allocations << std::setw(14) << frame.bytesAllocated << std::endl;
+    }
+
+    void MemoryTracker::recordAllocation(MemorySubsystem subsystem, size_t bytes) {
+        add(subsystemCounters[static_cast<size_t>(subsystem)], bytes);
+        add(totalCounters, bytes);
+    }
+
+    void MemoryTracker::recordDeallocation(MemorySubsystem subsystem, size_t bytes) {
+        remove(subsystemCounters[static_cast<size_t>(subsystem)], bytes);
+        remove(totalCounters, bytes);
+    }
+
+    MemoryScope::MemoryScope(MemorySubsystem subsystem) : _previous(currentSubsystem) {
+        currentSubsystem = subsystem;
+    }
+
+    MemoryScope::~MemoryScope() {
+        currentSubsystem = _previous;
+    }
+
+    static void *trackedAllocate(size_t bytes) noexcept {
+        void *block = std::malloc(sizeof(AllocationHeader) + bytes);
+        if(block == nullptr) {
+            return nullptr;
+        }
+        auto *header = static_cast<AllocationHeader *>(block);
+        header->bytes = bytes;
+        header->subsystem = currentSubsystem;
+        MemoryTracker::recordAllocation(header->subsystem, bytes);
+        return header + 1;
+    }
+
+    static void trackedFree(void *pointer) noexcept {
+        if(pointer == nullptr) {
+            return;
+        }
+        AllocationHeader *header = static_cast<AllocationHeader *>(pointer) - 1;
+        MemoryTracker::recordDeallocation(header->subsystem, header->bytes);
+        std::free(header);
+    }
+} // engine
+
+void *operator new(size_t bytes) {
+    void *pointer = engine::trackedAllocate(bytes);
+    if(pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void *operator new[](size_t bytes) {
+    return operator new(bytes);
+}
+
+void *operator new(size_t bytes, const std::nothrow_t &) noexcept {
+    return engine::trackedAllocate(bytes);
+}
+
+void *operator new[](size_t bytes, const std::nothrow_t &) noexcept {
+    return engine::trackedAllocate(bytes);
+}
+
+void operator delete(void *pointer) noexcept {
+    engine::trackedFree(pointer);
+}
+
+void operator delete[](void *pointer) noexcept {
+    engine::trackedFree(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept {
+    engine::trackedFree(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept {
+    engine::trackedFree(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept {
+    engine::trackedFree(pointer);
+}
+
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept {
+    engine::trackedFree(pointer);
+}
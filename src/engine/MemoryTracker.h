@@ -0,0 +1,77 @@
+//
+// Created by Maxime Boulanger on 2023-12-04.
+//
+
+#ifndef INC_3DGRAPHICSENGINE_MEMORYTRACKER_H
+#define INC_3DGRAPHICSENGINE_MEMORYTRACKER_H
+
+#include <cstddef>
+#include <ostream>
+
+namespace engine {
+
+    enum class MemorySubsystem {
+        Other,
+        Loader,
+        MeshStorage,
+        Input,
+        Geometry,
+        RenderSubmission,
+        Count
+    };
+
+    struct MemoryStatistics {
+        size_t allocations = 0;
+
+        size_t deallocations = 0;
+
+        size_t bytesAllocated = 0;
+
+        size_t liveBytes = 0;
+
+        size_t peakBytes = 0;
+    };
+
+    // Counts every global operator new/delete, attributed to the subsystem of the innermost MemoryScope.
+    class MemoryTracker {
+    public:
+        static void beginFrame();
+
+        static MemoryStatistics endFrame();
+
+        [[nodiscard]] static MemoryStatistics getStatistics(MemorySubsystem subsystem);
+
+        [[nodiscard]] static MemoryStatistics getFrameStatistics(MemorySubsystem subsystem);
+
+        [[nodiscard]] static MemoryStatistics getTotalStatistics();
+
+        [[nodiscard]] static MemorySubsystem getCurrentSubsystem();
+
+        static void setCurrentSubsystem(MemorySubsystem subsystem);
+
+        static const char *getSubsystemName(MemorySubsystem subsystem);
+
+        static void dump(std::ostream &out);
+
+        static void recordAllocation(MemorySubsystem subsystem, size_t bytes);
+
+        static void recordDeallocation(MemorySubsystem subsystem, size_t bytes);
+    };
+
+    class MemoryScope {
+    public:
+        explicit MemoryScope(MemorySubsystem subsystem);
+
+        ~MemoryScope();
+
+        MemoryScope(const MemoryScope &) = delete;
+
+        MemoryScope &operator=(const MemoryScope &) = delete;
+
+    private:
+        MemorySubsystem _previous;
+    };
+
+} // engine
+
+#endif //INC_3DGRAPHICSENGINE_MEMORYTRACKER_H
@@ -0,0 +1,112 @@
+//
+// Created by Maxime Boulanger on 2023-12-09.
+//
+
+#include "SceneGraph.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace engine {
+    SceneGraph::NodeId SceneGraph::createNode(NodeId parent) {
+        if(parent != NO_PARENT && parent >= _parents.size()) {
+            throw std::runtime_error("Parent node doesn't exist");
+        }
+        auto node = static_cast<NodeId>(_parents.size());
+        _parents.push_back(parent);
+        _locals.emplace_back();
+        _worlds.push_back({1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f});
+        _dirty.push_back(1);
+        _changed.push_back(0);
+        _anyDirty = true;
+        return node;
+    }
+
+    size_t SceneGraph::size() const {
+        return _parents.size();
+    }
+
+    SceneGraph::NodeId SceneGraph::getParent(NodeId node) const {
+        return _parents[node];
+    }
+
+    void SceneGraph::_markDirty(NodeId node) {
+        _dirty[node] = 1;
+        _anyDirty = true;
+    }
+
+    void SceneGraph::setTranslation(NodeId node, float x, float y, float z) {
+        LocalTransform &local = _locals[node];
+        local.translationX = x;
+        local.translationY = y;
+        local.translationZ = z;
+        _markDirty(node);
+    }
+
+    void SceneGraph::setRotation(NodeId node, const Quaternion &rotation) {
+        _locals[node].rotation = rotation;
+        _markDirty(node);
+    }
+
+    void SceneGraph::setScale(NodeId node, float x, float y, float z) {
+        LocalTransform &local = _locals[node];
+        local.scaleX = x;
+        local.scaleY = y;
+        local.scaleZ = z;
+        _markDirty(node);
+    }
+
+    const Quaternion &SceneGraph::getRotation(NodeId node) const {
+        return _locals[node].rotation;
+    }
+
+    size_t SceneGraph::update() {
+        if(!_anyDirty) {
+            return 0;
+        }
+
+        size_t updated = 0;
+        for(size_t i = 0; i < _parents.size(); ++i) {
+            NodeId parent = _parents[i];
+            bool parentChanged = parent != NO_PARENT && _changed[parent];
+            _changed[i] = _dirty[i] || parentChanged;
+            _dirty[i] = 0;
+            if(!_changed[i]) {
+                continue;
+            }
+
+            // Local matrix in row vector convention: scale, then rotate, then translate.
+            const LocalTransform &local = _locals[i];
+            float m[16];
+            local.rotation.toRotationMatrix(m);
+            m[0] *= local.scaleX; m[1] *= local.scaleX; m[2] *= local.scaleX; m[3] = 0.f;
+            m[4] *= local.scaleY; m[5] *= local.scaleY; m[6] *= local.scaleY; m[7] = 0.f;
+            m[8] *= local.scaleZ; m[9] *= local.scaleZ; m[10] *= local.scaleZ; m[11] = 0.f;
+            m[12] = local.translationX; m[13] = local.translationY; m[14] = local.translationZ; m[15] = 1.f;
+
+            std::array<float, 16> &world = _worlds[i];
+            if(parent == NO_PARENT) {
+                std::copy(m, m + 16, world.begin());
+            }
+            else {
+                const std::array<float, 16> &p = _worlds[parent];
+                for(size_t r = 0; r < 4; ++r) {
+                    for(size_t c = 0; c < 4; ++c) {
+                        world[r * 4 + c] = m[r * 4] * p[c] + m[r * 4 + 1] * p[4 + c] + m[r * 4 + 2] * p[8 + c] + m[r * 4 + 3] * p[12 + c];
+                    }
+                }
+            }
+            ++updated;
+        }
+        _anyDirty = false;
+        return updated;
+    }
+
+    const std::array<float, 16> &SceneGraph::getWorldTransform(NodeId node) const {
+        return _worlds[node];
+    }
+
+    Matrix SceneGraph::getWorldMatrix(NodeId node) const {
+        const std::array<float, 16> &world = _worlds[node];
+        return {4, std::vector<float>(world.begin(), world.end())};
+    }
+} // engine
@@ -0,0 +1,68 @@
+//
+// Created by Maxime Boulanger on 2023-12-09.
+//
+
+#ifndef INC_3DGRAPHICSENGINE_SCENEGRAPH_H
+#define INC_3DGRAPHICSENGINE_SCENEGRAPH_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "shapes/Matrix.h"
+#include "shapes/Quaternion.h"
+
+namespace engine {
+
+    // Nodes live in flat arrays where a parent always comes before its children, so one forward pass
+    // recomputes the world matrix of every dirty node and of everything below it.
+    class SceneGraph {
+    public:
+        using NodeId = uint32_t;
+
+        static const NodeId NO_PARENT = UINT32_MAX;
+
+        NodeId createNode(NodeId parent = NO_PARENT);
+
+        [[nodiscard]] size_t size() const;
+
+        [[nodiscard]] NodeId getParent(NodeId node) const;
+
+        void setTranslation(NodeId node, float x, float y, float z);
+
+        void setRotation(NodeId node, const Quaternion &rotation);
+
+        void setScale(NodeId node, float x, float y, float z);
+
+        [[nodiscard]] const Quaternion &getRotation(NodeId node) const;
+
+        size_t update();
+
+        [[nodiscard]] const std::array<float, 16> &getWorldTransform(NodeId node) const;
+
+        [[nodiscard]] Matrix getWorldMatrix(NodeId node) const;
+
+    private:
+        struct LocalTransform {
+            float translationX = 0.f, translationY = 0.f, translationZ = 0.f;
+            Quaternion rotation;
+            float scaleX = 1.f, scaleY = 1.f, scaleZ = 1.f;
+        };
+
+        std::vector<NodeId> _parents;
+
+        std::vector<LocalTransform> _locals;
+
+        std::vector<std::array<float, 16>> _worlds;
+
+        std::vector<uint8_t> _dirty;
+
+        std::vector<uint8_t> _changed;
+
+        bool _anyDirty = false;
+
+        void _markDirty(NodeId node);
+    };
+
+} // engine
+
+#endif //INC_3DGRAPHICSENGINE_SCENEGRAPH_H
@@ -6,13 +6,13 @@
 #include <iostream>
 
 namespace engine {
-    Matrix::Matrix(size_t rows, const std::vector<float> &data) : _nbRows(rows), _data(data) {
+    Matrix::Matrix(size_t rows, const std::vector<float> &data) : _nbRows(rows), _nbCols(data.size() / rows), _data(data) {
         if(data.size() % rows != 0) {
             throw std::runtime_error("Matrix rows must have the same amount of data");
         }
     }
 
-    Matrix::Matrix(const Matrix &m) : _nbRows(m._nbRows), _data(std::vector<float>(m._data)) {}
+    Matrix::Matrix(const Matrix &m) : _nbRows(m._nbRows), _nbCols(m._nbCols), _data(std::vector<float>(m._data)) {}
 
     float Matrix::at(size_t row, size_t col) const {
         return _data.at(row * cols() + col);
@@ -23,7 +23,11 @@ namespace engine {
     }
 
     size_t Matrix::cols() const {
-        return static_cast<size_t>(_data.size() / _nbRows);
+        return _nbCols;
+    }
+
+    size_t Matrix::getHeapBytes() const {
+        return _data.capacity() * sizeof(float);
     }
 
     void Matrix::set(size_t row, size_t col, float val) {
@@ -44,56 +48,38 @@ namespace engine {
 
     Matrix Matrix::getTransposition() const {
         Matrix t = Matrix(*this);
-        t._nbRows = cols();
+        t._nbRows = _nbCols;
+        t._nbCols = _nbRows;
         return t;
     }
 
     void Matrix::transpose() {
-        _nbRows = cols();
+        std::swap(_nbRows, _nbCols);
     }
 
-    Matrix Matrix::operator+(const Matrix &m) const{
-        if(cols() != m.cols() || _nbRows != m._nbRows) {
-            throw std::runtime_error("Size don't match");
+    Matrix Matrix::getAffineInverse() const {
+        if(rows() != 4 || cols() != 4) {
+            throw std::runtime_error("Affine inverse needs a 4x4 matrix");
         }
-        std::vector<float> newData = std::vector<float>();
-
-        for(size_t i = 0; i < _data.size(); ++i) {
-            newData.push_back(_data[i] + m._data[i]);
+        float a = at(0, 0), b = at(0, 1), c = at(0, 2);
+        float d = at(1, 0), e = at(1, 1), f = at(1, 2);
+        float g = at(2, 0), h = at(2, 1), i = at(2, 2);
+        float det = a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g);
+        if(det == 0.f) {
+            throw std::runtime_error("Matrix is not invertible");
         }
+        float invDet = 1.f / det;
+        float r00 = (e * i - f * h) * invDet, r01 = (c * h - b * i) * invDet, r02 = (b * f - c * e) * invDet;
+        float r10 = (f * g - d * i) * invDet, r11 = (a * i - c * g) * invDet, r12 = (c * d - a * f) * invDet;
+        float r20 = (d * h - e * g) * invDet, r21 = (b * g - a * h) * invDet, r22 = (a * e - b * d) * invDet;
+        float tx = at(3, 0), ty = at(3, 1), tz = at(3, 2);
 
-        return {_nbRows, newData};
-    }
-
-    Matrix Matrix::operator-(const Matrix &m) const {
-        if(cols() != m.cols() || _nbRows != m._nbRows) {
-            throw std::runtime_error("Size don't match");
-        }
-        std::vector<float> newData = std::vector<float>();
-
-        for(size_t i = 0; i < _data.size(); ++i) {
-            newData.push_back(_data[i] - m._data[i]);
-        }
-
-        return {_nbRows, newData};
-    }
-
-    Matrix Matrix::operator*(const Matrix &m) const {
-        if(cols() != m._nbRows) {
-            throw std::runtime_error("Size don't match");
-        }
-        std::vector<float> newData = std::vector<float>();
-
-        for(size_t i = 0; i < rows(); ++i) {
-            for(size_t j = 0; j < m.cols(); ++j) {
-                float newVal = 0;
-                for(size_t k = 0; k < cols(); ++k) {
-                    newVal += at(i, k) * m.at(k, j);
-                }
-                newData.push_back(newVal);
-            }
-        }
-        return {rows(), newData};
+        return {4, std::vector<float>({
+            r00, r01, r02, 0.f,
+            r10, r11, r12, 0.f,
+            r20, r21, r22, 0.f,
+            -(tx * r00 + ty * r10 + tz * r20), -(tx * r01 + ty * r11 + tz * r21), -(tx * r02 + ty * r12 + tz * r22), 1.f
+        })};
     }
 
     Matrix Matrix::zeros(size_t rows, size_t cols) {
@@ -113,16 +99,6 @@ namespace engine {
         return {rows, data};
     }
 
-    Matrix Matrix::operator*(float scalar) {
-        std::vector<float> newData = std::vector<float>();
-
-        std::transform(_data.begin(), _data.end(), std::back_inserter(newData), [&scalar](float x) {
-            return x * scalar;
-        });
-
-        return {_nbRows, newData};
-    }
-
     void Matrix::operator*=(float scalar) {
         for(auto &x: _data) {
             x *= scalar;
@@ -144,8 +120,12 @@ namespace engine {
 
     Vec::Vec(const Matrix &m) : Matrix(m) {}
 
+    Vec::Vec(Matrix &&m) : Matrix(std::move(m)) {}
+
     Vec3DGraphic::Vec3DGraphic(const Matrix &m) : Vec(m) {}
 
+    Vec3DGraphic::Vec3DGraphic(Matrix &&m) : Vec(std::move(m)) {}
+
     Vec3DGraphic::Vec3DGraphic(float x, float y, float z, float w) : Vec(std::vector<float>({x, y, z, w})) {}
 
     Vec3DGraphic::Vec3DGraphic(float x, float y, float z) : Vec(std::vector<float>({x, y, z, 1})){}
@@ -154,13 +134,13 @@ namespace engine {
 
     Vec3DGraphic Vec3DGraphic::multiplyByMatrix(const Matrix &m) const {
 
-        Matrix vec = Matrix::operator*(m);
+        Vec3DGraphic vec = Vec3DGraphic(*this * m);
         float w = vec.at(0, 3);
         if(w != 0.0f) {
             float wInv = 1 / w;
             vec *= wInv;
         }
-        return Vec3DGraphic(vec);
+        return vec;
     }
 
     float Vec3DGraphic::getX() const {
@@ -6,16 +6,35 @@
 #define INC_3DGRAPHICSENGINE_MATRIX_H
 
 #include <vector>
+#include "MatrixExpression.h"
 
 namespace engine {
 
-    class Matrix {
+    class Matrix : public MatrixExpression<Matrix> {
     public:
+        static constexpr size_t ROWS = DYNAMIC_SIZE;
+        static constexpr size_t COLS = DYNAMIC_SIZE;
+        static constexpr bool IS_LEAF = true;
 
         Matrix(size_t rows, const std::vector<float> &data);
 
         Matrix(const Matrix &m);
 
+        Matrix(Matrix &&m) noexcept = default;
+
+        // Evaluates a whole expression such as a * b + c in one pass into a single allocation.
+        template<typename E>
+        Matrix(const MatrixExpression<E> &expression) : _nbRows(expression.derived().rows()), _nbCols(expression.derived().cols()),
+                                                        _data(_nbRows * _nbCols) {
+            for(size_t r = 0; r < _nbRows; ++r) {
+                expression.derived().evaluateRow(r, &_data[r * _nbCols]);
+            }
+        }
+
+        Matrix &operator=(const Matrix &m) = default;
+
+        Matrix &operator=(Matrix &&m) noexcept = default;
+
         [[nodiscard]] float at(size_t row, size_t col) const;
 
         void set(size_t row, size_t col, float val);
@@ -24,17 +43,21 @@ namespace engine {
 
         [[nodiscard]] size_t cols() const;
 
-        Matrix getTransposition() const;
+        [[nodiscard]] size_t getHeapBytes() const;
 
-        void transpose();
+        [[nodiscard]] float coeff(size_t row, size_t col) const {
+            return _data[row * _nbCols + col];
+        }
 
-        Matrix operator+(const Matrix &m) const;
+        void evaluateRow(size_t row, float *out) const {
+            std::copy_n(_data.begin() + static_cast<std::ptrdiff_t>(row * _nbCols), _nbCols, out);
+        }
 
-        Matrix operator-(const Matrix &m) const;
+        Matrix getTransposition() const;
 
-        Matrix operator*(const Matrix &m) const;
+        void transpose();
 
-        Matrix operator*(float scalar);
+        [[nodiscard]] Matrix getAffineInverse() const;
 
         void operator*=(float scalar);
 
@@ -51,16 +74,72 @@ namespace engine {
 
     protected:
         size_t _nbRows;
+        size_t _nbCols;
         std::vector<float> _data;
 
     };
 
+    // Matrix with sizes known at compile time: stored inline and dimension mismatches fail to compile.
+    template<size_t Rows, size_t Cols>
+    class FixedMatrix : public MatrixExpression<FixedMatrix<Rows, Cols>> {
+    public:
+        static constexpr size_t ROWS = Rows;
+        static constexpr size_t COLS = Cols;
+        static constexpr bool IS_LEAF = true;
+
+        FixedMatrix() = default;
+
+        explicit FixedMatrix(const std::array<float, Rows * Cols> &data) : _data(data) {}
+
+        template<typename E>
+        FixedMatrix(const MatrixExpression<E> &expression) {
+            static_assert(E::ROWS == DYNAMIC_SIZE || E::ROWS == Rows, "Row counts don't match");
+            static_assert(E::COLS == DYNAMIC_SIZE || E::COLS == Cols, "Column counts don't match");
+            const E &e = expression.derived();
+            if(e.rows() != Rows || e.cols() != Cols) {
+                throw std::runtime_error("Size don't match");
+            }
+            for(size_t r = 0; r < Rows; ++r) {
+                e.evaluateRow(r, &_data[r * Cols]);
+            }
+        }
+
+        [[nodiscard]] float at(size_t row, size_t col) const {
+            return _data.at(row * Cols + col);
+        }
+
+        void set(size_t row, size_t col, float val) {
+            _data[row * Cols + col] = val;
+        }
+
+        [[nodiscard]] constexpr size_t rows() const {
+            return Rows;
+        }
+
+        [[nodiscard]] constexpr size_t cols() const {
+            return Cols;
+        }
+
+        [[nodiscard]] float coeff(size_t row, size_t col) const {
+            return _data[row * Cols + col];
+        }
+
+        void evaluateRow(size_t row, float *out) const {
+            std::copy_n(_data.begin() + static_cast<std::ptrdiff_t>(row * Cols), Cols, out);
+        }
+
+    private:
+        std::array<float, Rows * Cols> _data{};
+    };
+
     class Vec : public Matrix {
     public:
         explicit Vec(const std::vector<float> &data);
 
         explicit Vec(const Matrix &m);
 
+        explicit Vec(Matrix &&m);
+
     };
 
     class Vec3DGraphic: public Vec {
@@ -74,6 +153,8 @@ namespace engine {
 
         explicit Vec3DGraphic(const Matrix &m);
 
+        explicit Vec3DGraphic(Matrix &&m);
+
         float getX() const;
 
         float getY() const;
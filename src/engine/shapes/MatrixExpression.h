@@ -0,0 +1,271 @@
+//
+// Created by Maxime Boulanger on 2023-12-14.
+//
+
+#ifndef INC_3DGRAPHICSENGINE_MATRIXEXPRESSION_H
+#define INC_3DGRAPHICSENGINE_MATRIXEXPRESSION_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace engine {
+
+    // Dimension of an expression whose size is only known at runtime.
+    constexpr size_t DYNAMIC_SIZE = 0;
+
+    class Matrix;
+
+    template<size_t Rows, size_t Cols>
+    class FixedMatrix;
+
+    // Base of every lazy matrix expression. Operators only build a tree of small nodes; the whole tree is
+    // evaluated row by row when it is assigned to a Matrix or FixedMatrix, straight into its storage.
+    // Each expression provides ROWS, COLS, IS_LEAF, rows(), cols(), coeff(row, col) and evaluateRow(row, out).
+    template<typename E>
+    class MatrixExpression {
+    public:
+        [[nodiscard]] const E &derived() const {
+            return static_cast<const E &>(*this);
+        }
+    };
+
+    template<typename E>
+    E expressionTypeOf(const MatrixExpression<E> &);
+
+    // Expression type of an operand as the operators receive it, so a Vec3DGraphic is seen as the Matrix it derives from.
+    template<typename T>
+    using ExpressionType = decltype(expressionTypeOf(std::declval<const T &>()));
+
+    template<typename T>
+    concept MatrixOperand = requires(const T &operand) { expressionTypeOf(operand); };
+
+    // Only leaves passed as lvalues are held by reference. Temporary leaves and intermediate nodes are held by value,
+    // so an expression kept in an auto variable never refers to an operand destroyed at the end of its statement.
+    template<typename T>
+    using ExpressionOperand = std::conditional_t<std::is_lvalue_reference_v<T> && ExpressionType<T>::IS_LEAF,
+                                                 const ExpressionType<T> &, ExpressionType<T>>;
+
+    template<typename E>
+    using EvaluatedMatrix = std::conditional_t<E::ROWS != DYNAMIC_SIZE && E::COLS != DYNAMIC_SIZE, FixedMatrix<E::ROWS, E::COLS>, Matrix>;
+
+    // Scratch row owned by an expression node. Rows of the small matrices the engine uses stay inline, wider
+    // rows share one heap buffer for the whole evaluation. Copies start empty since the content is never shared.
+    class RowBuffer {
+    public:
+        RowBuffer() = default;
+
+        RowBuffer(const RowBuffer &) {}
+
+        RowBuffer &operator=(const RowBuffer &) {
+            return *this;
+        }
+
+        [[nodiscard]] float *data(size_t size) {
+            if(size <= INLINE_CAPACITY) {
+                return _inline.data();
+            }
+            if(_heap.size() < size) {
+                _heap.resize(size);
+            }
+            return _heap.data();
+        }
+
+    private:
+        static constexpr size_t INLINE_CAPACITY = 16;
+
+        std::array<float, INLINE_CAPACITY> _inline{};
+        std::vector<float> _heap;
+    };
+
+    // Operand types are ExpressionOperand types: either a const reference to a leaf or an expression held by value.
+    template<typename LeftOperand, typename RightOperand, typename Operation>
+    class MatrixElementwise : public MatrixExpression<MatrixElementwise<LeftOperand, RightOperand, Operation>> {
+        using L = std::remove_cvref_t<LeftOperand>;
+        using R = std::remove_cvref_t<RightOperand>;
+
+    public:
+        static constexpr size_t ROWS = L::ROWS != DYNAMIC_SIZE ? L::ROWS : R::ROWS;
+        static constexpr size_t COLS = L::COLS != DYNAMIC_SIZE ? L::COLS : R::COLS;
+        static constexpr bool IS_LEAF = false;
+
+        static_assert(L::ROWS == DYNAMIC_SIZE || R::ROWS == DYNAMIC_SIZE || L::ROWS == R::ROWS, "Row counts don't match");
+        static_assert(L::COLS == DYNAMIC_SIZE || R::COLS == DYNAMIC_SIZE || L::COLS == R::COLS, "Column counts don't match");
+
+        template<typename A, typename B>
+        MatrixElementwise(A &&left, B &&right) : _left(std::forward<A>(left)), _right(std::forward<B>(right)) {
+            if constexpr(L::ROWS == DYNAMIC_SIZE || R::ROWS == DYNAMIC_SIZE || L::COLS == DYNAMIC_SIZE || R::COLS == DYNAMIC_SIZE) {
+                if(_left.rows() != _right.rows() || _left.cols() != _right.cols()) {
+                    throw std::runtime_error("Size don't match");
+                }
+            }
+        }
+
+        [[nodiscard]] size_t rows() const {
+            return _left.rows();
+        }
+
+        [[nodiscard]] size_t cols() const {
+            return _left.cols();
+        }
+
+        [[nodiscard]] float coeff(size_t row, size_t col) const {
+            return Operation()(_left.coeff(row, col), _right.coeff(row, col));
+        }
+
+        void evaluateRow(size_t row, float *out) const {
+            size_t nbCols = cols();
+            _left.evaluateRow(row, out);
+            if constexpr(R::IS_LEAF) {
+                for(size_t c = 0; c < nbCols; ++c) {
+                    out[c] = Operation()(out[c], _right.coeff(row, c));
+                }
+            }
+            else {
+                float *rightRow = _rightRow.data(nbCols);
+                _right.evaluateRow(row, rightRow);
+                for(size_t c = 0; c < nbCols; ++c) {
+                    out[c] = Operation()(out[c], rightRow[c]);
+                }
+            }
+        }
+
+    private:
+        LeftOperand _left;
+        RightOperand _right;
+        mutable RowBuffer _rightRow;
+    };
+
+    template<typename Operand>
+    class MatrixScaled : public MatrixExpression<MatrixScaled<Operand>> {
+        using E = std::remove_cvref_t<Operand>;
+
+    public:
+        static constexpr size_t ROWS = E::ROWS;
+        static constexpr size_t COLS = E::COLS;
+        static constexpr bool IS_LEAF = false;
+
+        template<typename A>
+        MatrixScaled(A &&operand, float scalar) : _operand(std::forward<A>(operand)), _scalar(scalar) {}
+
+        [[nodiscard]] size_t rows() const {
+            return _operand.rows();
+        }
+
+        [[nodiscard]] size_t cols() const {
+            return _operand.cols();
+        }
+
+        [[nodiscard]] float coeff(size_t row, size_t col) const {
+            return _operand.coeff(row, col) * _scalar;
+        }
+
+        void evaluateRow(size_t row, float *out) const {
+            size_t nbCols = cols();
+            _operand.evaluateRow(row, out);
+            for(size_t c = 0; c < nbCols; ++c) {
+                out[c] *= _scalar;
+            }
+        }
+
+    private:
+        Operand _operand;
+        float _scalar;
+    };
+
+    template<typename LeftOperand, typename RightOperand>
+    class MatrixProduct : public MatrixExpression<MatrixProduct<LeftOperand, RightOperand>> {
+        using L = std::remove_cvref_t<LeftOperand>;
+        using R = std::remove_cvref_t<RightOperand>;
+
+    public:
+        static constexpr size_t ROWS = L::ROWS;
+        static constexpr size_t COLS = R::COLS;
+        static constexpr bool IS_LEAF = false;
+
+        static_assert(L::COLS == DYNAMIC_SIZE || R::ROWS == DYNAMIC_SIZE || L::COLS == R::ROWS, "Inner dimensions don't match");
+
+        template<typename A, typename B>
+        MatrixProduct(A &&left, B &&right) : _left(std::forward<A>(left)), _right(std::forward<B>(right)) {
+            if constexpr(L::COLS == DYNAMIC_SIZE || R::ROWS == DYNAMIC_SIZE) {
+                if(_left.cols() != _right.rows()) {
+                    throw std::runtime_error("Size don't match");
+                }
+            }
+        }
+
+        [[nodiscard]] size_t rows() const {
+            return _left.rows();
+        }
+
+        [[nodiscard]] size_t cols() const {
+            return _right.cols();
+        }
+
+        [[nodiscard]] float coeff(size_t row, size_t col) const {
+            size_t inner = _left.cols();
+            float value = 0;
+            for(size_t k = 0; k < inner; ++k) {
+                value += _left.coeff(row, k) * _right.coeff(k, col);
+            }
+            return value;
+        }
+
+        // A left-nested chain such as a * b * c only keeps one scratch row per product, never a whole temporary.
+        void evaluateRow(size_t row, float *out) const {
+            size_t inner = _left.cols();
+            size_t nbCols = cols();
+            float *leftRow = _leftRow.data(inner);
+            _left.evaluateRow(row, leftRow);
+            std::fill_n(out, nbCols, 0.f);
+            for(size_t k = 0; k < inner; ++k) {
+                float value = leftRow[k];
+                for(size_t c = 0; c < nbCols; ++c) {
+                    out[c] += value * _right.coeff(k, c);
+                }
+            }
+        }
+
+    private:
+        // The right side is read coefficient by coefficient for every row, so a nested expression there
+        // is evaluated once up front instead of being recomputed per coefficient.
+        using RightStorage = std::conditional_t<R::IS_LEAF, RightOperand, EvaluatedMatrix<R>>;
+
+        LeftOperand _left;
+        RightStorage _right;
+        mutable RowBuffer _leftRow;
+    };
+
+    template<MatrixOperand L, MatrixOperand R>
+    MatrixElementwise<ExpressionOperand<L>, ExpressionOperand<R>, std::plus<float>> operator+(L &&left, R &&right) {
+        return {std::forward<L>(left), std::forward<R>(right)};
+    }
+
+    template<MatrixOperand L, MatrixOperand R>
+    MatrixElementwise<ExpressionOperand<L>, ExpressionOperand<R>, std::minus<float>> operator-(L &&left, R &&right) {
+        return {std::forward<L>(left), std::forward<R>(right)};
+    }
+
+    template<MatrixOperand L, MatrixOperand R>
+    MatrixProduct<ExpressionOperand<L>, ExpressionOperand<R>> operator*(L &&left, R &&right) {
+        return {std::forward<L>(left), std::forward<R>(right)};
+    }
+
+    template<MatrixOperand E>
+    MatrixScaled<ExpressionOperand<E>> operator*(E &&operand, float scalar) {
+        return {std::forward<E>(operand), scalar};
+    }
+
+    template<MatrixOperand E>
+    MatrixScaled<ExpressionOperand<E>> operator*(float scalar, E &&operand) {
+        return {std::forward<E>(operand), scalar};
+    }
+
+} // engine
+
+#endif //INC_3DGRAPHICSENGINE_MATRIXEXPRESSION_H
@@ -3,23 +3,423 @@
 //
 
 #include "Mesh.h"
+#include "../MemoryTracker.h"
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <strstream>
+#include <unordered_map>
 
 namespace engine {
-    Mesh::Mesh(const std::vector<Triangle3D> &triangles) : _triangles(triangles) {}
+    Mesh::Mesh(const std::vector<Triangle3D> &triangles) {
+        MemoryScope scope(MemorySubsystem::MeshStorage);
+        _triangles = triangles;
+        _computeBounds();
+        _buildMeshlets();
+        _bvh = TriangleBVH(*this);
+    }
 
     Mesh::Mesh() : _triangles(std::vector<Triangle3D>()){}
 
+    static const float QUANTIZATION_STEPS = 65535.f;
+
+    static const float NORMAL_STEPS = 32767.f;
+
+    static const size_t MESHLET_MAX_TRIANGLES = 96;
+
+    // Below this spread between the cone axis and a normal, the cone is too wide to ever cull.
+    static const float MESHLET_MIN_CONE_DOT = 0.1f;
+
     const std::vector<Triangle3D> &Mesh::getTriangles() const {
+        if(_compressed) {
+            throw std::runtime_error("Triangles of a compressed mesh must be read through transformVertices");
+        }
         return _triangles;
     }
 
     void Mesh::setTriangles(const std::vector<Triangle3D> &triangles) {
+        MemoryScope scope(MemorySubsystem::MeshStorage);
         _triangles = triangles;
+        _compressed = false;
+        _quantizedX = std::vector<uint16_t>();
+        _quantizedY = std::vector<uint16_t>();
+        _quantizedZ = std::vector<uint16_t>();
+        _indices = std::vector<uint32_t>();
+        _encodedNormals = std::vector<int16_t>();
+        _computeBounds();
+        _buildMeshlets();
+        _bvh = TriangleBVH(*this);
+    }
+
+    size_t Mesh::getTriangleCount() const {
+        return _compressed ? _indices.size() / 3 : _triangles.size();
+    }
+
+    bool Mesh::isCompressed() const {
+        return _compressed;
+    }
+
+    bool Mesh::hasEncodedNormals() const {
+        return !_encodedNormals.empty();
+    }
+
+    const std::vector<uint32_t> &Mesh::getIndices() const {
+        return _indices;
+    }
+
+    static float signNotZero(float v) {
+        return v >= 0.f ? 1.f : -1.f;
+    }
+
+    static int16_t toSnorm(float v) {
+        return static_cast<int16_t>(std::lround(std::clamp(v, -1.f, 1.f) * NORMAL_STEPS));
+    }
+
+    void Mesh::compress(bool encodeNormals) {
+        if(_compressed) {
+            return;
+        }
+        MemoryScope scope(MemorySubsystem::MeshStorage);
+
+        float minX = _boundsMin.getX(), minY = _boundsMin.getY(), minZ = _boundsMin.getZ();
+        float extentX = std::max(_boundsMax.getX() - minX, 1e-6f);
+        float extentY = std::max(_boundsMax.getY() - minY, 1e-6f);
+        float extentZ = std::max(_boundsMax.getZ() - minZ, 1e-6f);
+
+        // Vertices landing on the same quantized position are merged.
+        std::unordered_map<uint64_t, uint32_t> vertexIndices = std::unordered_map<uint64_t, uint32_t>();
+        _indices.reserve(3 * _triangles.size());
+        if(encodeNormals) {
+            _encodedNormals.reserve(2 * _triangles.size());
+        }
+        for(const auto &triangle : _triangles) {
+            for(const Vec3DGraphic *p : {&triangle.getP1(), &triangle.getP2(), &triangle.getP3()}) {
+                auto qx = static_cast<uint16_t>(std::lround((p->getX() - minX) / extentX * QUANTIZATION_STEPS));
+                auto qy = static_cast<uint16_t>(std::lround((p->getY() - minY) / extentY * QUANTIZATION_STEPS));
+                auto qz = static_cast<uint16_t>(std::lround((p->getZ() - minZ) / extentZ * QUANTIZATION_STEPS));
+                uint64_t key = (static_cast<uint64_t>(qx) << 32) | (static_cast<uint64_t>(qy) << 16) | qz;
+                auto found = vertexIndices.find(key);
+                if(found == vertexIndices.end()) {
+                    found = vertexIndices.emplace(key, static_cast<uint32_t>(_quantizedX.size())).first;
+                    _quantizedX.push_back(qx);
+                    _quantizedY.push_back(qy);
+                    _quantizedZ.push_back(qz);
+                }
+                _indices.push_back(found->second);
+            }
+
+            if(encodeNormals) {
+                Vec3DGraphic normal = triangle.getNormal();
+                float l1 = std::fabs(normal.getX()) + std::fabs(normal.getY()) + std::fabs(normal.getZ());
+                float u = normal.getX() / l1;
+                float v = normal.getY() / l1;
+                if(normal.getZ() < 0.f) {
+                    float foldedU = (1.f - std::fabs(v)) * signNotZero(u);
+                    float foldedV = (1.f - std::fabs(u)) * signNotZero(v);
+                    u = foldedU;
+                    v = foldedV;
+                }
+                _encodedNormals.push_back(toSnorm(u));
+                _encodedNormals.push_back(toSnorm(v));
+            }
+        }
+        _quantizedX.shrink_to_fit();
+        _quantizedY.shrink_to_fit();
+        _quantizedZ.shrink_to_fit();
+        _triangles = std::vector<Triangle3D>();
+        _compressed = true;
+        // Rebuilt over the quantized positions so the leaf bounds enclose the vertices queries will read.
+        _bvh = TriangleBVH(*this);
+    }
+
+    void Mesh::transformVertices(const Matrix &worldMatrix, VertexBuffer &out) const {
+        // Dequantization is folded into the affine world transform: p = (min + q * step) * M = q * (step * M) + min * M.
+        float stepX = std::max(_boundsMax.getX() - _boundsMin.getX(), 1e-6f) / QUANTIZATION_STEPS;
+        float stepY = std::max(_boundsMax.getY() - _boundsMin.getY(), 1e-6f) / QUANTIZATION_STEPS;
+        float stepZ = std::max(_boundsMax.getZ() - _boundsMin.getZ(), 1e-6f) / QUANTIZATION_STEPS;
+        float minX = _boundsMin.getX(), minY = _boundsMin.getY(), minZ = _boundsMin.getZ();
+
+        float m[4][3];
+        for(size_t c = 0; c < 3; ++c) {
+            m[0][c] = stepX * worldMatrix.at(0, c);
+            m[1][c] = stepY * worldMatrix.at(1, c);
+            m[2][c] = stepZ * worldMatrix.at(2, c);
+            m[3][c] = minX * worldMatrix.at(0, c) + minY * worldMatrix.at(1, c) + minZ * worldMatrix.at(2, c) + worldMatrix.at(3, c);
+        }
+
+        size_t count = _quantizedX.size();
+        out.x.resize(count);
+        out.y.resize(count);
+        out.z.resize(count);
+        const uint16_t *qx = _quantizedX.data();
+        const uint16_t *qy = _quantizedY.data();
+        const uint16_t *qz = _quantizedZ.data();
+        float *x = out.x.data();
+        float *y = out.y.data();
+        float *z = out.z.data();
+
+        // Structure of arrays without aliasing between inputs and outputs, so the decode and the transform vectorize together.
+        for(size_t i = 0; i < count; ++i) {
+            auto fx = static_cast<float>(qx[i]);
+            auto fy = static_cast<float>(qy[i]);
+            auto fz = static_cast<float>(qz[i]);
+            x[i] = fx * m[0][0] + fy * m[1][0] + fz * m[2][0] + m[3][0];
+            y[i] = fx * m[0][1] + fy * m[1][1] + fz * m[2][1] + m[3][1];
+            z[i] = fx * m[0][2] + fy * m[1][2] + fz * m[2][2] + m[3][2];
+        }
+    }
+
+    void Mesh::getTriangleVertices(uint32_t triangle, float *vertices) const {
+        if(!_compressed) {
+            const Triangle3D &t = _triangles[triangle];
+            const Vec3DGraphic *points[3] = {&t.getP1(), &t.getP2(), &t.getP3()};
+            for(size_t i = 0; i < 3; ++i) {
+                vertices[3 * i] = points[i]->getX();
+                vertices[3 * i + 1] = points[i]->getY();
+                vertices[3 * i + 2] = points[i]->getZ();
+            }
+            return;
+        }
+        float stepX = std::max(_boundsMax.getX() - _boundsMin.getX(), 1e-6f) / QUANTIZATION_STEPS;
+        float stepY = std::max(_boundsMax.getY() - _boundsMin.getY(), 1e-6f) / QUANTIZATION_STEPS;
+        float stepZ = std::max(_boundsMax.getZ() - _boundsMin.getZ(), 1e-6f) / QUANTIZATION_STEPS;
+        for(size_t i = 0; i < 3; ++i) {
+            uint32_t index = _indices[3 * triangle + i];
+            vertices[3 * i] = _boundsMin.getX() + static_cast<float>(_quantizedX[index]) * stepX;
+            vertices[3 * i + 1] = _boundsMin.getY() + static_cast<float>(_quantizedY[index]) * stepY;
+            vertices[3 * i + 2] = _boundsMin.getZ() + static_cast<float>(_quantizedZ[index]) * stepZ;
+        }
+    }
+
+    Vec3DGraphic Mesh::decodeNormal(size_t triangle) const {
+        float u = static_cast<float>(_encodedNormals[2 * triangle]) / NORMAL_STEPS;
+        float v = static_cast<float>(_encodedNormals[2 * triangle + 1]) / NORMAL_STEPS;
+        float w = 1.f - std::fabs(u) - std::fabs(v);
+        if(w < 0.f) {
+            float unfoldedU = (1.f - std::fabs(v)) * signNotZero(u);
+            float unfoldedV = (1.f - std::fabs(u)) * signNotZero(v);
+            u = unfoldedU;
+            v = unfoldedV;
+        }
+        Vec3DGraphic normal = Vec3DGraphic(u, v, w, 0.f);
+        normal.normalize();
+        return normal;
+    }
+
+    const Vec3DGraphic &Mesh::getBoundsMin() const {
+        return _boundsMin;
+    }
+
+    const Vec3DGraphic &Mesh::getBoundsMax() const {
+        return _boundsMax;
+    }
+
+    void Mesh::_computeBounds() {
+        if(_triangles.empty()) {
+            _boundsMin = Vec3DGraphic();
+            _boundsMax = Vec3DGraphic();
+            return;
+        }
+        float minX = INFINITY, minY = INFINITY, minZ = INFINITY;
+        float maxX = -INFINITY, maxY = -INFINITY, maxZ = -INFINITY;
+        for(const auto &triangle : _triangles) {
+            for(const Vec3DGraphic *p : {&triangle.getP1(), &triangle.getP2(), &triangle.getP3()}) {
+                minX = std::min(minX, p->getX());
+                minY = std::min(minY, p->getY());
+                minZ = std::min(minZ, p->getZ());
+                maxX = std::max(maxX, p->getX());
+                maxY = std::max(maxY, p->getY());
+                maxZ = std::max(maxZ, p->getZ());
+            }
+        }
+        _boundsMin = Vec3DGraphic(minX, minY, minZ);
+        _boundsMax = Vec3DGraphic(maxX, maxY, maxZ);
+    }
+
+    const std::vector<Meshlet> &Mesh::getMeshlets() const {
+        return _meshlets;
+    }
+
+    const TriangleBVH &Mesh::getBVH() const {
+        return _bvh;
+    }
+
+    static uint32_t spreadBits(uint32_t v) {
+        v &= 0x3ff;
+        v = (v | (v << 16)) & 0x030000ff;
+        v = (v | (v << 8)) & 0x0300f00f;
+        v = (v | (v << 4)) & 0x030c30c3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    }
+
+    void Mesh::_buildMeshlets() {
+        _meshlets.clear();
+        if(_triangles.empty()) {
+            return;
+        }
+
+        // Triangles are grouped by the dominant axis of their normal so cones stay narrow, then ordered along
+        // a Morton curve of their centroid so each meshlet stays spatially compact.
+        float minX = _boundsMin.getX(), minY = _boundsMin.getY(), minZ = _boundsMin.getZ();
+        float extentX = std::max(_boundsMax.getX() - minX, 1e-6f);
+        float extentY = std::max(_boundsMax.getY() - minY, 1e-6f);
+        float extentZ = std::max(_boundsMax.getZ() - minZ, 1e-6f);
+
+        std::vector<Vec3DGraphic> normals = std::vector<Vec3DGraphic>();
+        std::vector<std::pair<uint64_t, size_t>> keys = std::vector<std::pair<uint64_t, size_t>>();
+        normals.reserve(_triangles.size());
+        keys.reserve(_triangles.size());
+        for(size_t t = 0; t < _triangles.size(); ++t) {
+            const Triangle3D &triangle = _triangles[t];
+            Vec3DGraphic normal = triangle.getNormal();
+            normals.push_back(normal);
+
+            float ax = std::fabs(normal.getX()), ay = std::fabs(normal.getY()), az = std::fabs(normal.getZ());
+            uint64_t face = 0;
+            if(std::isfinite(ax) && std::isfinite(ay) && std::isfinite(az)) {
+                if(ax >= ay && ax >= az) {
+                    face = normal.getX() >= 0.f ? 1 : 2;
+                }
+                else if(ay >= az) {
+                    face = normal.getY() >= 0.f ? 3 : 4;
+                }
+                else {
+                    face = normal.getZ() >= 0.f ? 5 : 6;
+                }
+            }
+
+            float cx = (triangle.getP1().getX() + triangle.getP2().getX() + triangle.getP3().getX()) / 3.f;
+            float cy = (triangle.getP1().getY() + triangle.getP2().getY() + triangle.getP3().getY()) / 3.f;
+            float cz = (triangle.getP1().getZ() + triangle.getP2().getZ() + triangle.getP3().getZ()) / 3.f;
+            auto mx = static_cast<uint32_t>((cx - minX) / extentX * 1023.f);
+            auto my = static_cast<uint32_t>((cy - minY) / extentY * 1023.f);
+            auto mz = static_cast<uint32_t>((cz - minZ) / extentZ * 1023.f);
+            uint64_t morton = spreadBits(mx) | (spreadBits(my) << 1) | (spreadBits(mz) << 2);
+            keys.emplace_back((face << 32) | morton, t);
+        }
+        std::sort(keys.begin(), keys.end());
+
+        std::vector<Triangle3D> ordered = std::vector<Triangle3D>();
+        std::vector<Vec3DGraphic> orderedNormals = std::vector<Vec3DGraphic>();
+        ordered.reserve(_triangles.size());
+        orderedNormals.reserve(_triangles.size());
+        for(const auto &key : keys) {
+            ordered.push_back(_triangles[key.second]);
+            orderedNormals.push_back(normals[key.second]);
+        }
+        _triangles = ordered;
+
+        size_t first = 0;
+        while(first < keys.size()) {
+            // A meshlet never mixes normal groups.
+            size_t last = first + 1;
+            while(last < keys.size() && last - first < MESHLET_MAX_TRIANGLES && (keys[last].first >> 32) == (keys[first].first >> 32)) {
+                ++last;
+            }
+
+            float boxMinX = INFINITY, boxMinY = INFINITY, boxMinZ = INFINITY;
+            float boxMaxX = -INFINITY, boxMaxY = -INFINITY, boxMaxZ = -INFINITY;
+            float axisX = 0.f, axisY = 0.f, axisZ = 0.f;
+            bool degenerate = false;
+            for(size_t t = first; t < last; ++t) {
+                for(const Vec3DGraphic *p : {&_triangles[t].getP1(), &_triangles[t].getP2(), &_triangles[t].getP3()}) {
+                    boxMinX = std::min(boxMinX, p->getX());
+                    boxMinY = std::min(boxMinY, p->getY());
+                    boxMinZ = std::min(boxMinZ, p->getZ());
+                    boxMaxX = std::max(boxMaxX, p->getX());
+                    boxMaxY = std::max(boxMaxY, p->getY());
+                    boxMaxZ = std::max(boxMaxZ, p->getZ());
+                }
+                const Vec3DGraphic &n = orderedNormals[t];
+                if(!std::isfinite(n.getX()) || !std::isfinite(n.getY()) || !std::isfinite(n.getZ())) {
+                    degenerate = true;
+                    continue;
+                }
+                axisX += n.getX();
+                axisY += n.getY();
+                axisZ += n.getZ();
+            }
+
+            Meshlet meshlet{};
+            meshlet.firstTriangle = static_cast<uint32_t>(first);
+            meshlet.triangleCount = static_cast<uint32_t>(last - first);
+            meshlet.centerX = 0.5f * (boxMinX + boxMaxX);
+            meshlet.centerY = 0.5f * (boxMinY + boxMaxY);
+            meshlet.centerZ = 0.5f * (boxMinZ + boxMaxZ);
+            float radius = 0.f;
+            for(size_t t = first; t < last; ++t) {
+                for(const Vec3DGraphic *p : {&_triangles[t].getP1(), &_triangles[t].getP2(), &_triangles[t].getP3()}) {
+                    float dx = p->getX() - meshlet.centerX, dy = p->getY() - meshlet.centerY, dz = p->getZ() - meshlet.centerZ;
+                    radius = std::max(radius, dx * dx + dy * dy + dz * dz);
+                }
+            }
+            meshlet.radius = sqrtf(radius);
+
+            float axisLength = sqrtf(axisX * axisX + axisY * axisY + axisZ * axisZ);
+            float minDot = -1.f;
+            if(!degenerate && axisLength > 0.f) {
+                axisX /= axisLength;
+                axisY /= axisLength;
+                axisZ /= axisLength;
+                minDot = 1.f;
+                for(size_t t = first; t < last; ++t) {
+                    const Vec3DGraphic &n = orderedNormals[t];
+                    minDot = std::min(minDot, n.getX() * axisX + n.getY() * axisY + n.getZ() * axisZ);
+                }
+            }
+            meshlet.coneAxisX = axisX;
+            meshlet.coneAxisY = axisY;
+            meshlet.coneAxisZ = axisZ;
+            // Sine of the cone half angle, a cutoff of 1 disables the cone test.
+            meshlet.coneCutoff = minDot < MESHLET_MIN_CONE_DOT ? 1.f : sqrtf(1.f - minDot * minDot);
+            _meshlets.push_back(meshlet);
+
+            first = last;
+        }
+    }
+
+    std::vector<Mesh> Mesh::splitIntoChunks(size_t chunksPerAxis) const {
+        if(_compressed) {
+            throw std::runtime_error("Can't split a compressed mesh");
+        }
+        MemoryScope scope(MemorySubsystem::MeshStorage);
+        std::vector<std::vector<Triangle3D>> chunks(chunksPerAxis * chunksPerAxis);
+        float sizeX = std::max(_boundsMax.getX() - _boundsMin.getX(), 1e-6f);
+        float sizeZ = std::max(_boundsMax.getZ() - _boundsMin.getZ(), 1e-6f);
+
+        for(const auto &triangle : _triangles) {
+            float centerX = (triangle.getP1().getX() + triangle.getP2().getX() + triangle.getP3().getX()) / 3.f;
+            float centerZ = (triangle.getP1().getZ() + triangle.getP2().getZ() + triangle.getP3().getZ()) / 3.f;
+            auto i = static_cast<size_t>((centerX - _boundsMin.getX()) / sizeX * static_cast<float>(chunksPerAxis));
+            auto j = static_cast<size_t>((centerZ - _boundsMin.getZ()) / sizeZ * static_cast<float>(chunksPerAxis));
+            i = std::min(i, chunksPerAxis - 1);
+            j = std::min(j, chunksPerAxis - 1);
+            chunks[j * chunksPerAxis + i].push_back(triangle);
+        }
+
+        std::vector<Mesh> meshes = std::vector<Mesh>();
+        for(const auto &chunk : chunks) {
+            if(!chunk.empty()) {
+                meshes.emplace_back(chunk);
+            }
+        }
+        return meshes;
+    }
+
+    size_t Mesh::getResidentBytes() const {
+        size_t bytes = sizeof(Mesh) + _triangles.capacity() * sizeof(Triangle3D);
+        bytes += (_quantizedX.capacity() + _quantizedY.capacity() + _quantizedZ.capacity()) * sizeof(uint16_t);
+        bytes += _indices.capacity() * sizeof(uint32_t) + _encodedNormals.capacity() * sizeof(int16_t);
+        bytes += _meshlets.capacity() * sizeof(Meshlet) + _bvh.getResidentBytes();
+        for(const auto &triangle : _triangles) {
+            bytes += triangle.getP1().getHeapBytes() + triangle.getP2().getHeapBytes() + triangle.getP3().getHeapBytes();
+        }
+        return bytes + _boundsMin.getHeapBytes() + _boundsMax.getHeapBytes();
     }
 
     Mesh Mesh::loadFromObjectFile(const std::string &filename) {
+        MemoryScope scope(MemorySubsystem::Loader);
         std::ifstream f(filename);
         if (!f.is_open()) {
             throw std::runtime_error("Can't open " + filename);
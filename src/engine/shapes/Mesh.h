@@ -5,11 +5,36 @@
 #ifndef INC_3DGRAPHICSENGINE_MESH_H
 #define INC_3DGRAPHICSENGINE_MESH_H
 
+#include <cstdint>
 #include <vector>
 #include "Triangle3D.h"
+#include "TriangleBVH.h"
 
 namespace engine {
 
+    struct VertexBuffer {
+        std::vector<float> x;
+
+        std::vector<float> y;
+
+        std::vector<float> z;
+    };
+
+    // Contiguous range of triangles with a bounding sphere and the cone holding all of their normals.
+    struct Meshlet {
+        uint32_t firstTriangle;
+
+        uint32_t triangleCount;
+
+        float centerX, centerY, centerZ;
+
+        float radius;
+
+        float coneAxisX, coneAxisY, coneAxisZ;
+
+        float coneCutoff;
+    };
+
     class Mesh {
     public:
         explicit Mesh(const std::vector<Triangle3D> &triangles);
@@ -20,10 +45,63 @@ namespace engine {
 
         void setTriangles(const std::vector<Triangle3D> &triangles);
 
+        [[nodiscard]] const Vec3DGraphic &getBoundsMin() const;
+
+        [[nodiscard]] const Vec3DGraphic &getBoundsMax() const;
+
+        [[nodiscard]] std::vector<Mesh> splitIntoChunks(size_t chunksPerAxis) const;
+
+        [[nodiscard]] size_t getResidentBytes() const;
+
+        [[nodiscard]] size_t getTriangleCount() const;
+
+        void compress(bool encodeNormals);
+
+        [[nodiscard]] bool isCompressed() const;
+
+        [[nodiscard]] bool hasEncodedNormals() const;
+
+        [[nodiscard]] const std::vector<uint32_t> &getIndices() const;
+
+        void transformVertices(const Matrix &worldMatrix, VertexBuffer &out) const;
+
+        // Writes the three corners of a triangle as x, y, z triplets, dequantized when the mesh is compressed.
+        void getTriangleVertices(uint32_t triangle, float *vertices) const;
+
+        [[nodiscard]] Vec3DGraphic decodeNormal(size_t triangle) const;
+
+        [[nodiscard]] const std::vector<Meshlet> &getMeshlets() const;
+
+        [[nodiscard]] const TriangleBVH &getBVH() const;
+
         static Mesh loadFromObjectFile(const std::string &filename);
 
     private:
         std::vector<Triangle3D> _triangles;
+
+        Vec3DGraphic _boundsMin;
+
+        Vec3DGraphic _boundsMax;
+
+        bool _compressed = false;
+
+        std::vector<uint16_t> _quantizedX;
+
+        std::vector<uint16_t> _quantizedY;
+
+        std::vector<uint16_t> _quantizedZ;
+
+        std::vector<uint32_t> _indices;
+
+        std::vector<int16_t> _encodedNormals;
+
+        std::vector<Meshlet> _meshlets;
+
+        TriangleBVH _bvh;
+
+        void _computeBounds();
+
+        void _buildMeshlets();
     };
 
 } // engine
@@ -0,0 +1,69 @@
+//
+// Created by Maxime Boulanger on 2023-12-09.
+//
+
+#include "Quaternion.h"
+#include <cmath>
+
+namespace engine {
+    Quaternion::Quaternion() : _w(1.f), _x(0.f), _y(0.f), _z(0.f) {}
+
+    Quaternion::Quaternion(float w, float x, float y, float z) : _w(w), _x(x), _y(y), _z(z) {}
+
+    float Quaternion::getW() const {
+        return _w;
+    }
+
+    float Quaternion::getX() const {
+        return _x;
+    }
+
+    float Quaternion::getY() const {
+        return _y;
+    }
+
+    float Quaternion::getZ() const {
+        return _z;
+    }
+
+    Quaternion Quaternion::operator*(const Quaternion &q) const {
+        return {
+            _w * q._w - _x * q._x - _y * q._y - _z * q._z,
+            _w * q._x + _x * q._w + _y * q._z - _z * q._y,
+            _w * q._y - _x * q._z + _y * q._w + _z * q._x,
+            _w * q._z + _x * q._y - _y * q._x + _z * q._w
+        };
+    }
+
+    void Quaternion::normalize() {
+        float norm = sqrtf(_w * _w + _x * _x + _y * _y + _z * _z);
+        _w /= norm;
+        _x /= norm;
+        _y /= norm;
+        _z /= norm;
+    }
+
+    void Quaternion::toRotationMatrix(float *m) const {
+        float xx = _x * _x, yy = _y * _y, zz = _z * _z;
+        float xy = _x * _y, xz = _x * _z, yz = _y * _z;
+        float wx = _w * _x, wy = _w * _y, wz = _w * _z;
+
+        m[0] = 1.f - 2.f * (yy + zz);
+        m[1] = 2.f * (xy + wz);
+        m[2] = 2.f * (xz - wy);
+
+        m[4] = 2.f * (xy - wz);
+        m[5] = 1.f - 2.f * (xx + zz);
+        m[6] = 2.f * (yz + wx);
+
+        m[8] = 2.f * (xz + wy);
+        m[9] = 2.f * (yz - wx);
+        m[10] = 1.f - 2.f * (xx + yy);
+    }
+
+    Quaternion Quaternion::fromAxisAngle(float x, float y, float z, float angle) {
+        float norm = sqrtf(x * x + y * y + z * z);
+        float s = sinf(0.5f * angle) / norm;
+        return {cosf(0.5f * angle), x * s, y * s, z * s};
+    }
+} // engine
@@ -0,0 +1,42 @@
+//
+// Created by Maxime Boulanger on 2023-12-09.
+//
+
+#ifndef INC_3DGRAPHICSENGINE_QUATERNION_H
+#define INC_3DGRAPHICSENGINE_QUATERNION_H
+
+namespace engine {
+
+    class Quaternion {
+    public:
+        Quaternion();
+
+        Quaternion(float w, float x, float y, float z);
+
+        [[nodiscard]] float getW() const;
+
+        [[nodiscard]] float getX() const;
+
+        [[nodiscard]] float getY() const;
+
+        [[nodiscard]] float getZ() const;
+
+        Quaternion operator*(const Quaternion &q) const;
+
+        void normalize();
+
+        // Rotation matrix for the engine's row vector convention (v * M), written to the upper 3x3 of a 4x4 row-major array.
+        void toRotationMatrix(float *m) const;
+
+        static Quaternion fromAxisAngle(float x, float y, float z, float angle);
+
+    private:
+        float _w;
+        float _x;
+        float _y;
+        float _z;
+    };
+
+} // engine
+
+#endif //INC_3DGRAPHICSENGINE_QUATERNION_H
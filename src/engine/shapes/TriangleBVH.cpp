@@ -0,0 +1,442 @@
+//
+// Created by Maxime Boulanger on 2023-12-12.
+//
+
+#include "TriangleBVH.h"
+#include "Mesh.h"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace engine {
+    static const size_t SAH_BINS = 12;
+
+    // Leaves are forced to split above this size, which keeps their count within Node::COUNT_BITS.
+    static const uint32_t MAX_LEAF_TRIANGLES = 8;
+
+    static const uint32_t MIN_SPLIT_TRIANGLES = 4;
+
+    // Cost of visiting a node relative to one triangle test. Without it the tree splits down to single
+    // triangles and the node array outgrows the mesh it indexes.
+    static const float NODE_TRAVERSAL_COST = 1.f;
+
+    static const size_t STACK_SIZE = 64;
+
+    static const size_t PACKET_SIZE = 8;
+
+    static const float RAY_EPSILON = 1e-7f;
+
+    // One step below the uint16 range so rounding a bound outwards never overflows.
+    static const float BOUNDS_STEPS = 65534.f;
+
+    static const uint16_t MAX_QUANTIZED_BOUND = UINT16_MAX;
+
+    struct Bounds {
+        float minX = INFINITY, minY = INFINITY, minZ = INFINITY;
+        float maxX = -INFINITY, maxY = -INFINITY, maxZ = -INFINITY;
+
+        void grow(const float *b) {
+            minX = std::min(minX, b[0]);
+            minY = std::min(minY, b[1]);
+            minZ = std::min(minZ, b[2]);
+            maxX = std::max(maxX, b[3]);
+            maxY = std::max(maxY, b[4]);
+            maxZ = std::max(maxZ, b[5]);
+        }
+
+        void grow(const Bounds &b) {
+            minX = std::min(minX, b.minX);
+            minY = std::min(minY, b.minY);
+            minZ = std::min(minZ, b.minZ);
+            maxX = std::max(maxX, b.maxX);
+            maxY = std::max(maxY, b.maxY);
+            maxZ = std::max(maxZ, b.maxZ);
+        }
+
+        [[nodiscard]] float area() const {
+            float x = maxX - minX, y = maxY - minY, z = maxZ - minZ;
+            return x < 0.f ? 0.f : x * y + y * z + z * x;
+        }
+    };
+
+    // Slab test returning the entry distance, or INFINITY on a miss.
+    static float intersectBox(float minX, float minY, float minZ, float maxX, float maxY, float maxZ,
+                              const Ray &ray, float invX, float invY, float invZ, float maxDistance) {
+        float tx1 = (minX - ray.originX) * invX, tx2 = (maxX - ray.originX) * invX;
+        float tmin = std::min(tx1, tx2), tmax = std::max(tx1, tx2);
+        float ty1 = (minY - ray.originY) * invY, ty2 = (maxY - ray.originY) * invY;
+        tmin = std::max(tmin, std::min(ty1, ty2));
+        tmax = std::min(tmax, std::max(ty1, ty2));
+        float tz1 = (minZ - ray.originZ) * invZ, tz2 = (maxZ - ray.originZ) * invZ;
+        tmin = std::max(tmin, std::min(tz1, tz2));
+        tmax = std::min(tmax, std::max(tz1, tz2));
+        return (tmax >= tmin && tmin < maxDistance && tmax > 0.f) ? tmin : INFINITY;
+    }
+
+    struct TriangleBVH::BuildNode {
+        Bounds box;
+        uint32_t leftOrFirst;
+        uint32_t count;
+    };
+
+    static uint16_t quantizeMin(float value, float origin, float step) {
+        float q = std::clamp(std::floor((value - origin) / step), 0.f, static_cast<float>(MAX_QUANTIZED_BOUND));
+        auto quantized = static_cast<uint16_t>(q);
+        while(quantized > 0 && origin + static_cast<float>(quantized) * step > value) {
+            --quantized;
+        }
+        return quantized;
+    }
+
+    static uint16_t quantizeMax(float value, float origin, float step) {
+        float q = std::clamp(std::ceil((value - origin) / step), 0.f, static_cast<float>(MAX_QUANTIZED_BOUND));
+        auto quantized = static_cast<uint16_t>(q);
+        while(quantized < MAX_QUANTIZED_BOUND && origin + static_cast<float>(quantized) * step < value) {
+            ++quantized;
+        }
+        return quantized;
+    }
+
+    TriangleBVH::TriangleBVH() = default;
+
+    TriangleBVH::TriangleBVH(const Mesh &mesh) {
+        size_t triangleCount = mesh.getTriangleCount();
+        if(triangleCount == 0) {
+            return;
+        }
+        if(triangleCount >= (size_t(1) << (32 - Node::COUNT_BITS - 1))) {
+            throw std::runtime_error("Mesh has too many triangles for a BVH");
+        }
+
+        std::vector<float> bounds = std::vector<float>(6 * triangleCount);
+        std::vector<float> centroids = std::vector<float>(3 * triangleCount);
+        _triangleIndices.resize(triangleCount);
+        float v[9];
+        for(size_t i = 0; i < triangleCount; ++i) {
+            mesh.getTriangleVertices(static_cast<uint32_t>(i), v);
+            float *b = &bounds[6 * i];
+            for(size_t a = 0; a < 3; ++a) {
+                b[a] = std::min({v[a], v[3 + a], v[6 + a]});
+                b[3 + a] = std::max({v[a], v[3 + a], v[6 + a]});
+                centroids[3 * i + a] = (v[a] + v[3 + a] + v[6 + a]) / 3.f;
+            }
+            _triangleIndices[i] = static_cast<uint32_t>(i);
+        }
+
+        std::vector<BuildNode> nodes = std::vector<BuildNode>();
+        nodes.reserve(2 * triangleCount);
+        nodes.push_back({Bounds(), 0, static_cast<uint32_t>(triangleCount)});
+        _updateBounds(nodes[0], bounds);
+        _subdivide(nodes, 0, bounds, centroids);
+
+        const Bounds &root = nodes[0].box;
+        _originX = root.minX;
+        _originY = root.minY;
+        _originZ = root.minZ;
+        _stepX = root.maxX > root.minX ? (root.maxX - root.minX) / BOUNDS_STEPS : 1.f;
+        _stepY = root.maxY > root.minY ? (root.maxY - root.minY) / BOUNDS_STEPS : 1.f;
+        _stepZ = root.maxZ > root.minZ ? (root.maxZ - root.minZ) / BOUNDS_STEPS : 1.f;
+
+        _nodes.reserve(nodes.size());
+        for(const BuildNode &node : nodes) {
+            _nodes.push_back({
+                quantizeMin(node.box.minX, _originX, _stepX), quantizeMin(node.box.minY, _originY, _stepY), quantizeMin(node.box.minZ, _originZ, _stepZ),
+                quantizeMax(node.box.maxX, _originX, _stepX), quantizeMax(node.box.maxY, _originY, _stepY), quantizeMax(node.box.maxZ, _originZ, _stepZ),
+                (node.leftOrFirst << Node::COUNT_BITS) | node.count
+            });
+        }
+    }
+
+    void TriangleBVH::_updateBounds(BuildNode &node, const std::vector<float> &bounds) const {
+        node.box = Bounds();
+        for(uint32_t i = 0; i < node.count; ++i) {
+            node.box.grow(&bounds[6 * _triangleIndices[node.leftOrFirst + i]]);
+        }
+    }
+
+    void TriangleBVH::_subdivide(std::vector<BuildNode> &nodes, uint32_t nodeIndex, const std::vector<float> &bounds, const std::vector<float> &centroids) {
+        uint32_t first = nodes[nodeIndex].leftOrFirst;
+        uint32_t count = nodes[nodeIndex].count;
+        if(count <= MIN_SPLIT_TRIANGLES) {
+            return;
+        }
+
+        float centroidMin[3] = {INFINITY, INFINITY, INFINITY};
+        float centroidMax[3] = {-INFINITY, -INFINITY, -INFINITY};
+        for(uint32_t i = first; i < first + count; ++i) {
+            for(size_t a = 0; a < 3; ++a) {
+                centroidMin[a] = std::min(centroidMin[a], centroids[3 * _triangleIndices[i] + a]);
+                centroidMax[a] = std::max(centroidMax[a], centroids[3 * _triangleIndices[i] + a]);
+            }
+        }
+
+        int bestAxis = -1;
+        size_t bestSplit = 0;
+        float bestCost = INFINITY;
+        for(size_t a = 0; a < 3; ++a) {
+            float extent = centroidMax[a] - centroidMin[a];
+            if(extent <= 0.f) {
+                continue;
+            }
+            Bounds binBounds[SAH_BINS];
+            uint32_t binCounts[SAH_BINS] = {};
+            float scale = static_cast<float>(SAH_BINS) / extent;
+            for(uint32_t i = first; i < first + count; ++i) {
+                uint32_t index = _triangleIndices[i];
+                size_t bin = std::min(SAH_BINS - 1, static_cast<size_t>((centroids[3 * index + a] - centroidMin[a]) * scale));
+                ++binCounts[bin];
+                binBounds[bin].grow(&bounds[6 * index]);
+            }
+
+            // Sweep from both ends so every split plane is costed in linear time.
+            float leftAreas[SAH_BINS - 1], rightAreas[SAH_BINS - 1];
+            uint32_t leftCounts[SAH_BINS - 1], rightCounts[SAH_BINS - 1];
+            Bounds left, right;
+            uint32_t leftSum = 0, rightSum = 0;
+            for(size_t i = 0; i < SAH_BINS - 1; ++i) {
+                leftSum += binCounts[i];
+                left.grow(binBounds[i]);
+                leftCounts[i] = leftSum;
+                leftAreas[i] = left.area();
+                rightSum += binCounts[SAH_BINS - 1 - i];
+                right.grow(binBounds[SAH_BINS - 1 - i]);
+                rightCounts[SAH_BINS - 2 - i] = rightSum;
+                rightAreas[SAH_BINS - 2 - i] = right.area();
+            }
+            for(size_t i = 0; i < SAH_BINS - 1; ++i) {
+                float cost = static_cast<float>(leftCounts[i]) * leftAreas[i] + static_cast<float>(rightCounts[i]) * rightAreas[i];
+                if(leftCounts[i] > 0 && rightCounts[i] > 0 && cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = static_cast<int>(a);
+                    bestSplit = i;
+                }
+            }
+        }
+
+        float area = nodes[nodeIndex].box.area();
+        float leafCost = static_cast<float>(count) * area;
+        if(count <= MAX_LEAF_TRIANGLES && (bestAxis < 0 || bestCost + NODE_TRAVERSAL_COST * area >= leafCost)) {
+            return;
+        }
+
+        // Triangles with identical centroids can't be binned apart, they are halved instead.
+        uint32_t leftCount = count / 2;
+        if(bestAxis >= 0) {
+            auto axis = static_cast<size_t>(bestAxis);
+            float scale = static_cast<float>(SAH_BINS) / (centroidMax[axis] - centroidMin[axis]);
+            auto middle = std::partition(_triangleIndices.begin() + first, _triangleIndices.begin() + first + count, [&](uint32_t index) {
+                return std::min(SAH_BINS - 1, static_cast<size_t>((centroids[3 * index + axis] - centroidMin[axis]) * scale)) <= bestSplit;
+            });
+            leftCount = static_cast<uint32_t>(middle - (_triangleIndices.begin() + first));
+        }
+
+        auto leftChild = static_cast<uint32_t>(nodes.size());
+        nodes.push_back({Bounds(), first, leftCount});
+        nodes.push_back({Bounds(), first + leftCount, count - leftCount});
+        nodes[nodeIndex].leftOrFirst = leftChild;
+        nodes[nodeIndex].count = 0;
+
+        _updateBounds(nodes[leftChild], bounds);
+        _updateBounds(nodes[leftChild + 1], bounds);
+        _subdivide(nodes, leftChild, bounds, centroids);
+        _subdivide(nodes, leftChild + 1, bounds, centroids);
+    }
+
+    float TriangleBVH::_intersectNode(const Node &node, const Ray &ray, float invX, float invY, float invZ, float maxDistance) const {
+        return intersectBox(_originX + static_cast<float>(node.minX) * _stepX, _originY + static_cast<float>(node.minY) * _stepY,
+                            _originZ + static_cast<float>(node.minZ) * _stepZ, _originX + static_cast<float>(node.maxX) * _stepX,
+                            _originY + static_cast<float>(node.maxY) * _stepY, _originZ + static_cast<float>(node.maxZ) * _stepZ,
+                            ray, invX, invY, invZ, maxDistance);
+    }
+
+    bool TriangleBVH::_intersectTriangle(const Mesh &mesh, uint32_t index, const Ray &ray, float &distance, float &u, float &v) const {
+        float p[9];
+        mesh.getTriangleVertices(_triangleIndices[index], p);
+        float e1X = p[3] - p[0], e1Y = p[4] - p[1], e1Z = p[5] - p[2];
+        float e2X = p[6] - p[0], e2Y = p[7] - p[1], e2Z = p[8] - p[2];
+
+        float px = ray.directionY * e2Z - ray.directionZ * e2Y;
+        float py = ray.directionZ * e2X - ray.directionX * e2Z;
+        float pz = ray.directionX * e2Y - ray.directionY * e2X;
+        float det = e1X * px + e1Y * py + e1Z * pz;
+        if(std::fabs(det) < RAY_EPSILON) {
+            return false;
+        }
+        float invDet = 1.f / det;
+        float sx = ray.originX - p[0], sy = ray.originY - p[1], sz = ray.originZ - p[2];
+        float hitU = (sx * px + sy * py + sz * pz) * invDet;
+        if(hitU < 0.f || hitU > 1.f) {
+            return false;
+        }
+        float qx = sy * e1Z - sz * e1Y;
+        float qy = sz * e1X - sx * e1Z;
+        float qz = sx * e1Y - sy * e1X;
+        float hitV = (ray.directionX * qx + ray.directionY * qy + ray.directionZ * qz) * invDet;
+        if(hitV < 0.f || hitU + hitV > 1.f) {
+            return false;
+        }
+        float hitDistance = (e2X * qx + e2Y * qy + e2Z * qz) * invDet;
+        if(hitDistance <= RAY_EPSILON || hitDistance >= distance) {
+            return false;
+        }
+        distance = hitDistance;
+        u = hitU;
+        v = hitV;
+        return true;
+    }
+
+    bool TriangleBVH::intersectClosest(const Mesh &mesh, const Ray &ray, RayHit &hit) const {
+        if(_nodes.empty()) {
+            return false;
+        }
+        float invX = 1.f / ray.directionX, invY = 1.f / ray.directionY, invZ = 1.f / ray.directionZ;
+        float distance = std::min(ray.maxDistance, hit.distance);
+        uint32_t hitIndex = UINT32_MAX;
+
+        uint32_t stack[STACK_SIZE];
+        size_t stackSize = 0;
+        stack[stackSize++] = 0;
+        while(stackSize > 0) {
+            const Node &node = _nodes[stack[--stackSize]];
+            if(_intersectNode(node, ray, invX, invY, invZ, distance) == INFINITY) {
+                continue;
+            }
+            if(node.count() > 0) {
+                for(uint32_t i = node.leftOrFirst(); i < node.leftOrFirst() + node.count(); ++i) {
+                    if(_intersectTriangle(mesh, i, ray, distance, hit.u, hit.v)) {
+                        hitIndex = i;
+                    }
+                }
+                continue;
+            }
+
+            // Visit the nearer child first so the farther one is often skipped.
+            const Node &left = _nodes[node.leftOrFirst()];
+            const Node &right = _nodes[node.leftOrFirst() + 1];
+            float leftDistance = _intersectNode(left, ray, invX, invY, invZ, distance);
+            float rightDistance = _intersectNode(right, ray, invX, invY, invZ, distance);
+            uint32_t nearChild = leftDistance <= rightDistance ? node.leftOrFirst() : node.leftOrFirst() + 1;
+            uint32_t farChild = leftDistance <= rightDistance ? node.leftOrFirst() + 1 : node.leftOrFirst();
+            if(std::max(leftDistance, rightDistance) != INFINITY) {
+                stack[stackSize++] = farChild;
+            }
+            if(std::min(leftDistance, rightDistance) != INFINITY) {
+                stack[stackSize++] = nearChild;
+            }
+        }
+
+        if(hitIndex == UINT32_MAX) {
+            return false;
+        }
+        hit.distance = distance;
+        hit.triangle = _triangleIndices[hitIndex];
+        return true;
+    }
+
+    bool TriangleBVH::intersectAny(const Mesh &mesh, const Ray &ray) const {
+        if(_nodes.empty()) {
+            return false;
+        }
+        float invX = 1.f / ray.directionX, invY = 1.f / ray.directionY, invZ = 1.f / ray.directionZ;
+        float distance = ray.maxDistance;
+        float u, v;
+
+        uint32_t stack[STACK_SIZE];
+        size_t stackSize = 0;
+        stack[stackSize++] = 0;
+        while(stackSize > 0) {
+            const Node &node = _nodes[stack[--stackSize]];
+            if(_intersectNode(node, ray, invX, invY, invZ, distance) == INFINITY) {
+                continue;
+            }
+            if(node.count() > 0) {
+                for(uint32_t i = node.leftOrFirst(); i < node.leftOrFirst() + node.count(); ++i) {
+                    if(_intersectTriangle(mesh, i, ray, distance, u, v)) {
+                        return true;
+                    }
+                }
+                continue;
+            }
+            stack[stackSize++] = node.leftOrFirst() + 1;
+            stack[stackSize++] = node.leftOrFirst();
+        }
+        return false;
+    }
+
+    void TriangleBVH::intersectClosest(const Mesh &mesh, const std::vector<Ray> &rays, std::vector<RayHit> &hits) const {
+        hits.assign(rays.size(), RayHit());
+        if(_nodes.empty()) {
+            return;
+        }
+
+        // Rays of a packet walk the tree together, a node is entered when any of them reaches it.
+        for(size_t first = 0; first < rays.size(); first += PACKET_SIZE) {
+            size_t packetSize = std::min(PACKET_SIZE, rays.size() - first);
+            float invX[PACKET_SIZE], invY[PACKET_SIZE], invZ[PACKET_SIZE], distances[PACKET_SIZE];
+            uint32_t hitIndices[PACKET_SIZE];
+            for(size_t r = 0; r < packetSize; ++r) {
+                const Ray &ray = rays[first + r];
+                invX[r] = 1.f / ray.directionX;
+                invY[r] = 1.f / ray.directionY;
+                invZ[r] = 1.f / ray.directionZ;
+                distances[r] = ray.maxDistance;
+                hitIndices[r] = UINT32_MAX;
+            }
+
+            // Each entry keeps the first ray still inside the parent, rays before it can be skipped for the subtree.
+            std::pair<uint32_t, size_t> stack[STACK_SIZE];
+            size_t stackSize = 0;
+            stack[stackSize++] = {0, 0};
+            while(stackSize > 0) {
+                auto [nodeIndex, firstCandidate] = stack[--stackSize];
+                const Node &node = _nodes[nodeIndex];
+                bool active[PACKET_SIZE] = {};
+                size_t firstActive = packetSize;
+                for(size_t r = firstCandidate; r < packetSize; ++r) {
+                    active[r] = _intersectNode(node, rays[first + r], invX[r], invY[r], invZ[r], distances[r]) != INFINITY;
+                    if(active[r] && firstActive == packetSize) {
+                        firstActive = r;
+                    }
+                }
+                if(firstActive == packetSize) {
+                    continue;
+                }
+                if(node.count() > 0) {
+                    for(uint32_t i = node.leftOrFirst(); i < node.leftOrFirst() + node.count(); ++i) {
+                        for(size_t r = firstActive; r < packetSize; ++r) {
+                            if(active[r] && _intersectTriangle(mesh, i, rays[first + r], distances[r], hits[first + r].u, hits[first + r].v)) {
+                                hitIndices[r] = i;
+                            }
+                        }
+                    }
+                    continue;
+                }
+
+                // The first active ray orders the children, coherent rays mostly agree with it.
+                const Ray &ray = rays[first + firstActive];
+                const Node &left = _nodes[node.leftOrFirst()];
+                const Node &right = _nodes[node.leftOrFirst() + 1];
+                float leftDistance = _intersectNode(left, ray, invX[firstActive], invY[firstActive], invZ[firstActive], INFINITY);
+                float rightDistance = _intersectNode(right, ray, invX[firstActive], invY[firstActive], invZ[firstActive], INFINITY);
+                bool leftFirst = leftDistance <= rightDistance;
+                stack[stackSize++] = {leftFirst ? node.leftOrFirst() + 1 : node.leftOrFirst(), firstActive};
+                stack[stackSize++] = {leftFirst ? node.leftOrFirst() : node.leftOrFirst() + 1, firstActive};
+            }
+
+            for(size_t r = 0; r < packetSize; ++r) {
+                if(hitIndices[r] != UINT32_MAX) {
+                    hits[first + r].distance = distances[r];
+                    hits[first + r].triangle = _triangleIndices[hitIndices[r]];
+                }
+            }
+        }
+    }
+
+    size_t TriangleBVH::getNodeCount() const {
+        return _nodes.size();
+    }
+
+    size_t TriangleBVH::getResidentBytes() const {
+        return _nodes.capacity() * sizeof(Node) + _triangleIndices.capacity() * sizeof(uint32_t);
+    }
+} // engine
@@ -0,0 +1,95 @@
+//
+// Created by Maxime Boulanger on 2023-12-12.
+//
+
+#ifndef INC_3DGRAPHICSENGINE_TRIANGLEBVH_H
+#define INC_3DGRAPHICSENGINE_TRIANGLEBVH_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace engine {
+
+    struct Ray {
+        float originX, originY, originZ;
+
+        float directionX, directionY, directionZ;
+
+        float maxDistance = INFINITY;
+    };
+
+    // Distance is in units of the ray direction, so it survives affine transforms of the ray.
+    struct RayHit {
+        float distance = INFINITY;
+
+        uint32_t triangle = UINT32_MAX;
+
+        float u = 0.f;
+
+        float v = 0.f;
+    };
+
+    class Mesh;
+
+    // Bounding volume hierarchy over a mesh's triangles, built with the binned surface area heuristic.
+    // Leaves only hold triangle indices: vertices are read back from the mesh, quantized or not, so the
+    // hierarchy adds no copy of the geometry. Queries take the mesh the hierarchy was built from.
+    class TriangleBVH {
+    public:
+        TriangleBVH();
+
+        explicit TriangleBVH(const Mesh &mesh);
+
+        bool intersectClosest(const Mesh &mesh, const Ray &ray, RayHit &hit) const;
+
+        [[nodiscard]] bool intersectAny(const Mesh &mesh, const Ray &ray) const;
+
+        void intersectClosest(const Mesh &mesh, const std::vector<Ray> &rays, std::vector<RayHit> &hits) const;
+
+        [[nodiscard]] size_t getNodeCount() const;
+
+        [[nodiscard]] size_t getResidentBytes() const;
+
+    private:
+        struct BuildNode;
+
+        // 16 bytes: bounds quantized against the root box, rounded outwards so they stay conservative, and
+        // the first child or first triangle packed with the triangle count. A count of 0 marks an interior
+        // node whose children are leftOrFirst() and leftOrFirst() + 1.
+        struct Node {
+            static constexpr uint32_t COUNT_BITS = 4;
+
+            uint16_t minX, minY, minZ;
+            uint16_t maxX, maxY, maxZ;
+            uint32_t packed;
+
+            [[nodiscard]] uint32_t leftOrFirst() const {
+                return packed >> COUNT_BITS;
+            }
+
+            [[nodiscard]] uint32_t count() const {
+                return packed & ((1u << COUNT_BITS) - 1);
+            }
+        };
+
+        std::vector<Node> _nodes;
+
+        std::vector<uint32_t> _triangleIndices;
+
+        float _originX = 0.f, _originY = 0.f, _originZ = 0.f;
+
+        float _stepX = 1.f, _stepY = 1.f, _stepZ = 1.f;
+
+        void _subdivide(std::vector<BuildNode> &nodes, uint32_t nodeIndex, const std::vector<float> &bounds, const std::vector<float> &centroids);
+
+        void _updateBounds(BuildNode &node, const std::vector<float> &bounds) const;
+
+        [[nodiscard]] float _intersectNode(const Node &node, const Ray &ray, float invX, float invY, float invZ, float maxDistance) const;
+
+        [[nodiscard]] bool _intersectTriangle(const Mesh &mesh, uint32_t index, const Ray &ray, float &distance, float &u, float &v) const;
+    };
+
+} // engine
+
+#endif //INC_3DGRAPHICSENGINE_TRIANGLEBVH_H
@@ -1,11 +1,36 @@
 #include <SFML/Graphics.hpp>
+#include <iostream>
+#include <stdexcept>
+#include <string>
 #include "engine/GameEngine.h"
-int main()
+int main(int argc, char *argv[])
 {
-    auto fullScreen = sf::VideoMode::getFullscreenModes()[1];
-    engine::GameEngine eng = engine::GameEngine(255, 680, 468);
+    try {
+        auto fullScreen = sf::VideoMode::getFullscreenModes()[1];
+        engine::GameEngine eng = engine::GameEngine(255, 680, 468);
 
-    eng.startLoop();
+        for(int i = 1; i < argc; ++i) {
+            if(std::string(argv[i]) == "--strict-memory") {
+                eng.setStrictMemoryMode(true);
+            }
+            else if(std::string(argv[i]) == "--compress-meshes") {
+                eng.compressMeshes(false);
+            }
+            else if(std::string(argv[i]) == "--compress-meshes-and-normals") {
+                eng.compressMeshes(true);
+            }
+            else if(std::string(argv[i]) == "--record" && i + 1 < argc) {
+                eng.recordInput(argv[++i]);
+            }
+            else if(std::string(argv[i]) == "--replay" && i + 1 < argc) {
+                eng.replayInput(argv[++i]);
+            }
+        }
 
-
-}
\ No newline at end of file
+        return eng.startLoop() ? 0 : 1;
+    }
+    catch(const std::runtime_error &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}